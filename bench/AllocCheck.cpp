@@ -0,0 +1,267 @@
+/**
+ * @brief Steady-state allocation guard for the relay hot path
+ * 
+ * Interposes global operator new/delete and the malloc family (glibc __libc_*)
+ * for this binary and counts calls only while a measured phase is open, i.e.
+ * only inside Server::runOnce(); harness-side buffering is never counted.
+ * 
+ * Each scenario runs on an in-process server (socketpair clients, see bench/inproc):
+ *   channel_privmsg   one member relays to a --members channel
+ *   private_privmsg   one client messages another by nick
+ *   ping              PING -> PONG
+ * after --warmup untimed repetitions (buffers reach their steady capacity) the
+ * next --iterations are counted. The check fails when allocations/op of a
+ * scenario exceed its budget: 0 unless overridden with --budget-<scenario> N
+ * or a budget file (--budgets <file>, lines "<scenario> <max allocs/op>").
+ * 
+ * Usage: alloccheck [--members N] [--warmup N] [--iterations N] [--budgets <file>] [--json <file>]
+ */
+
+#include "BenchCommon.hpp"
+#include "network/Server.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+extern "C" {
+	void*	__libc_malloc(std::size_t size);
+	void*	__libc_calloc(std::size_t n, std::size_t size);
+	void*	__libc_realloc(void* p, std::size_t size);
+	void	__libc_free(void* p);
+}
+
+// = Interposed allocator with per-phase counters =
+
+namespace {
+
+struct AllocCounters {
+	std::uint64_t	news;				// operator new / new[]
+	std::uint64_t	deletes;
+	std::uint64_t	mallocs;			// malloc / calloc / realloc called directly (not through new)
+	std::uint64_t	frees;
+	std::uint64_t	bytes;
+};
+
+bool			g_counting = false;
+AllocCounters	g_counters = { 0, 0, 0, 0, 0 };
+
+void* countedNew(std::size_t size) {
+	if (g_counting) {
+		++g_counters.news;
+		g_counters.bytes += size;
+	}
+	void* p = __libc_malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void countedDelete(void* p) {
+	if (g_counting && p)
+		++g_counters.deletes;
+	__libc_free(p);
+}
+
+}
+
+extern "C" void* malloc(std::size_t size) {
+	if (g_counting) {
+		++g_counters.mallocs;
+		g_counters.bytes += size;
+	}
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(std::size_t n, std::size_t size) {
+	if (g_counting) {
+		++g_counters.mallocs;
+		g_counters.bytes += n * size;
+	}
+	return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* p, std::size_t size) {
+	if (g_counting) {
+		++g_counters.mallocs;
+		g_counters.bytes += size;
+	}
+	return __libc_realloc(p, size);
+}
+
+extern "C" void free(void* p) {
+	if (g_counting && p)
+		++g_counters.frees;
+	__libc_free(p);
+}
+
+void* operator new(std::size_t size) { return countedNew(size); }
+void* operator new[](std::size_t size) { return countedNew(size); }
+void operator delete(void* p) noexcept { countedDelete(p); }
+void operator delete[](void* p) noexcept { countedDelete(p); }
+void operator delete(void* p, std::size_t) noexcept { countedDelete(p); }
+void operator delete[](void* p, std::size_t) noexcept { countedDelete(p); }
+
+// = Harness =
+
+namespace {
+
+struct Pair {
+	int				fd;					// harness end
+	std::string		nick;
+};
+
+// Server-side work until idle; counted only if `measure`
+void serve(Server& server, bool measure) {
+	g_counting = measure;
+	while (server.runOnce(0) > 0)
+		;
+	g_counting = false;
+}
+
+// Drain every harness end into a fixed buffer (no allocation, not counted anyway)
+std::size_t drain(const std::vector<Pair>& pairs) {
+	static char buf[65536];
+	std::size_t total = 0;
+	for (std::size_t i = 0; i < pairs.size() && pairs[i].fd >= 0; ++i) {
+		ssize_t n;
+		while ((n = read(pairs[i].fd, buf, sizeof(buf))) > 0)
+			total += static_cast<std::size_t>(n);
+	}
+	return total;
+}
+
+void writeLine(const Pair& p, const std::string& line) {
+	std::string data = line + "\r\n";
+	if (write(p.fd, data.data(), data.size()) != static_cast<ssize_t>(data.size()))
+		std::perror("alloccheck: write");
+}
+
+struct Scenario {
+	const char*		name;
+	std::size_t		from;
+	std::string		line;
+};
+
+struct Outcome {
+	std::string		name;
+	double			allocs_per_op;		// news + mallocs
+	double			news_per_op;
+	double			bytes_per_op;
+	double			budget;
+	std::size_t		reply_bytes;		// bytes the clients received for one op (sanity)
+};
+
+}
+
+int main(int ac, char* av[]) {
+	BenchOptions opts(ac, av, 1);
+	std::size_t members = static_cast<std::size_t>(opts.getLong("members", 10));
+	std::size_t warmup = static_cast<std::size_t>(opts.getLong("warmup", 200));
+	std::size_t iterations = static_cast<std::size_t>(opts.getLong("iterations", 1000));
+	const std::string password = "alloc";
+	if (members < 2)
+		members = 2;
+
+	Server server(password);
+	Pair unattached = { -1, "" };
+	std::vector<Pair> pairs(members, unattached);		// drain() stops at the first unattached pair
+	for (std::size_t i = 0; i < members; ++i) {
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 || !server.attachClient(sv[0])) {
+			std::perror("alloccheck: socketpair");
+			return 1;
+		}
+		fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL, 0) | O_NONBLOCK);
+		pairs[i].fd = sv[1];
+		pairs[i].nick = "a" + std::to_string(i);
+		writeLine(pairs[i], "PASS " + password);
+		writeLine(pairs[i], "NICK " + pairs[i].nick);
+		writeLine(pairs[i], "USER " + pairs[i].nick + " 0 * :alloc check");
+		serve(server, false);
+		writeLine(pairs[i], "JOIN #room");
+		serve(server, false);
+		drain(pairs);
+	}
+
+	const Scenario scenarios[] = {
+		{ "channel_privmsg", 0, "PRIVMSG #room :steady state relay through the channel" },
+		{ "private_privmsg", 0, "PRIVMSG a1 :steady state private message" },
+		{ "ping", 0, "PING :alloc-token" },
+	};
+
+	// Budgets: 0 unless a budget file or --budget-<name> raises them
+	std::map<std::string, double> budgets;
+	if (opts.has("budgets")) {
+		std::ifstream in(opts.get("budgets", "").c_str());
+		std::string name;
+		double value;
+		while (in >> name) {
+			if (name[0] == '#') {
+				std::getline(in, name);
+				continue;
+			}
+			if (in >> value)
+				budgets[name] = value;
+		}
+	}
+
+	std::vector<Outcome> outcomes;
+	bool failed = false;
+	for (std::size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); ++s) {
+		const Scenario& sc = scenarios[s];
+		for (std::size_t i = 0; i < warmup; ++i) {
+			writeLine(pairs[sc.from], sc.line);
+			serve(server, false);
+			drain(pairs);
+		}
+		g_counters = AllocCounters();
+		std::size_t reply_bytes = 0;
+		for (std::size_t i = 0; i < iterations; ++i) {
+			writeLine(pairs[sc.from], sc.line);
+			serve(server, true);
+			reply_bytes = drain(pairs);
+		}
+		Outcome o;
+		o.name = sc.name;
+		o.news_per_op = static_cast<double>(g_counters.news) / static_cast<double>(iterations);
+		o.allocs_per_op = static_cast<double>(g_counters.news + g_counters.mallocs) / static_cast<double>(iterations);
+		o.bytes_per_op = static_cast<double>(g_counters.bytes) / static_cast<double>(iterations);
+		o.budget = budgets.count(o.name) ? budgets[o.name] : 0.0;
+		o.budget = opts.getDouble("budget-" + o.name, o.budget);
+		o.reply_bytes = reply_bytes;
+		bool ok = o.allocs_per_op <= o.budget && reply_bytes > 0;
+		failed = failed || !ok;
+		std::printf("%-18s %8.2f allocs/op (%6.2f new) %9.1f bytes/op  budget %6.2f  %s\n", o.name.c_str(),
+			o.allocs_per_op, o.news_per_op, o.bytes_per_op, o.budget, ok ? "ok" : "FAIL");
+		outcomes.push_back(o);
+	}
+
+	JsonWriter json;
+	json.beginObject();
+	json.field("mode", "alloccheck");
+	json.field("members", static_cast<std::uint64_t>(members));
+	json.field("iterations", static_cast<std::uint64_t>(iterations));
+	json.beginArray("scenarios");
+	for (std::size_t i = 0; i < outcomes.size(); ++i) {
+		json.beginObject();
+		json.field("name", outcomes[i].name);
+		json.field("allocs_per_op", outcomes[i].allocs_per_op);
+		json.field("news_per_op", outcomes[i].news_per_op);
+		json.field("bytes_per_op", outcomes[i].bytes_per_op);
+		json.field("budget", outcomes[i].budget);
+		json.endObject();
+	}
+	json.endArray();
+	json.field("passed", !failed);
+	json.endObject();
+	if (opts.has("json"))
+		benchWriteFile(opts.get("json", ""), json.str());
+	for (std::size_t i = 0; i < pairs.size(); ++i)
+		close(pairs[i].fd);
+	return failed ? 1 : 0;
+}
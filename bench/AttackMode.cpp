@@ -0,0 +1,293 @@
+#include "BenchModes.hpp"
+#include "network/Client.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+/**
+ * @brief "attack" mode: legitimate-user latency and server RSS under hostile clients
+ * 
+ * --legit clients share #legit and exchange PRIVMSG at --rate msgs/s during every
+ * phase. Each phase (--phases, comma list) adds one kind of attacker for
+ * --phase-duration seconds, then the attackers disconnect and the server gets
+ * --settle-ms to recover before the next phase:
+ *   baseline   no attackers
+ *   idle       --idle-conns sockets that connect and never register or send
+ *   slowloris  --slow-conns unregistered sockets trickling one endless line toward MAX_INBUF
+ *   oversized  --flood-conns registered clients sending --flood-size byte PRIVMSG lines to #legit
+ *   unknown    --spam-conns registered clients spamming an unknown command (replies are read)
+ *   nonreader  --nonreaders registered clients requesting WHO on a --crowd member channel
+ *              and never reading, so the replies pile up in the server's output buffers
+ */
+
+namespace {
+
+struct PhaseResult {
+	std::string		name;
+	std::uint64_t	sent;
+	std::uint64_t	expected;
+	std::uint64_t	delivered;
+	LatencySamples	latency;
+	long			rss_start_kb;
+	long			rss_peak_kb;
+	long			rss_settled_kb;		// after the attackers left and --settle-ms passed
+	std::size_t		attackers;
+	std::size_t		attackers_dropped;	// closed by the server during the phase
+	std::uint64_t	attack_bytes;
+
+	PhaseResult() : name(), sent(0), expected(0), delivered(0), latency(), rss_start_kb(-1),
+		rss_peak_kb(-1), rss_settled_kb(-1), attackers(0), attackers_dropped(0), attack_bytes(0) {}
+};
+
+struct AttackConfig {
+	std::size_t		idle_conns;
+	std::size_t		slow_conns;
+	std::size_t		flood_conns;
+	std::size_t		flood_size;
+	std::size_t		spam_conns;
+	std::size_t		nonreaders;
+	std::size_t		crowd;
+};
+
+// Legitimate side: send on schedule, collect latency from "BENCH <ns>" payloads
+void pumpLegit(std::vector<BenchConn>& legit, PhaseResult& r, std::uint64_t phase_start,
+	double rate, std::mt19937& rng) {
+	std::uint64_t due = static_cast<std::uint64_t>(static_cast<double>(benchNowNs() - phase_start) / 1e9 * rate);
+	std::uniform_int_distribution<std::size_t> pick(0, legit.size() - 1);
+	for (; r.sent < due; ++r.sent) {
+		BenchConn& from = legit[pick(rng)];
+		benchQueue(from, "PRIVMSG #legit :BENCH " + std::to_string(benchNowNs()) + " " + std::to_string(r.sent));
+		r.expected += legit.size() - 1;
+	}
+	benchPoll(legit, 1);
+	std::string line;
+	for (std::size_t i = 0; i < legit.size(); ++i) {
+		while (benchNextLine(legit[i], line)) {
+			std::size_t pos = line.find(" :BENCH ");
+			if (pos != std::string::npos && line.find(" PRIVMSG ") != std::string::npos) {
+				++r.delivered;
+				r.latency.add(benchNowNs() - std::strtoull(line.c_str() + pos + 8, NULL, 10));
+			} else if (line.compare(0, 5, "PING ") == 0)
+				benchQueue(legit[i], "PONG " + line.substr(5));
+		}
+	}
+}
+
+// Open the attackers of one phase; false if the server refused to take them
+bool setupAttackers(const std::string& phase, const BenchTarget& target, const AttackConfig& cfg,
+	std::vector<BenchConn>& attackers, std::vector<BenchConn>& crowd) {
+	std::size_t raw = 0;
+	if (phase == "idle")
+		raw = cfg.idle_conns;
+	else if (phase == "slowloris")
+		raw = cfg.slow_conns;
+	if (raw > 0) {
+		attackers.assign(raw, BenchConn());
+		for (std::size_t i = 0; i < raw; ++i) {
+			attackers[i].fd = benchConnect(target.host, target.port);
+			if (attackers[i].fd < 0)
+				return false;
+		}
+		return true;
+	}
+	if (phase == "oversized" || phase == "unknown") {
+		std::size_t n = phase == "oversized" ? cfg.flood_conns : cfg.spam_conns;
+		if (!benchConnectAll(target, phase == "oversized" ? "flood" : "spam", n, attackers))
+			return false;
+		if (phase == "oversized") {
+			for (std::size_t i = 0; i < n; ++i)
+				benchQueue(attackers[i], "JOIN #legit");
+			return benchWaitNumeric(attackers, "366", std::vector<int>(n, 1), 30000);
+		}
+		return true;
+	}
+	if (phase == "nonreader") {
+		if (!benchConnectAll(target, "crowd", cfg.crowd, crowd))
+			return false;
+		for (std::size_t i = 0; i < crowd.size(); ++i)
+			benchQueue(crowd[i], "JOIN #crowd");
+		if (!benchWaitNumeric(crowd, "366", std::vector<int>(crowd.size(), 1), 60000))
+			return false;
+		if (!benchConnectAll(target, "lurk", cfg.nonreaders, attackers))
+			return false;
+		for (std::size_t i = 0; i < attackers.size(); ++i)
+			attackers[i].no_read = true;
+	}
+	return true;
+}
+
+// Keep each attacker's pressure up; called every loop iteration
+void driveAttackers(const std::string& phase, const AttackConfig& cfg, std::vector<BenchConn>& attackers,
+	std::vector<std::size_t>& progress, std::uint64_t phase_start, std::uint64_t& bytes) {
+	std::uint64_t elapsed_ms = (benchNowNs() - phase_start) / 1000000ull;
+	for (std::size_t i = 0; i < attackers.size(); ++i) {
+		BenchConn& a = attackers[i];
+		if (a.closed || !a.outbuf.empty())
+			continue;
+		std::string chunk;
+		if (phase == "slowloris") {
+			// 256 bytes every 100 ms up to just under MAX_INBUF, then one byte per second
+			const std::size_t ramp_end = MAX_INBUF - 192;
+			std::size_t want = progress[i] < ramp_end ? static_cast<std::size_t>(elapsed_ms / 100 + 1) * 256
+				: ramp_end + static_cast<std::size_t>(elapsed_ms / 1000);
+			want = std::min<std::size_t>(want, MAX_INBUF - 2);
+			if (progress[i] == 0 && want > 0)
+				chunk = "PRIVMSG #legit :";
+			if (want > progress[i] + chunk.size())
+				chunk += std::string(want - progress[i] - chunk.size(), 'A');
+		} else if (phase == "oversized")
+			chunk = "PRIVMSG #legit :" + std::string(cfg.flood_size, 'F') + "\r\n";
+		else if (phase == "unknown")
+			chunk = "XYZZY plugh plover :nothing happens\r\n";
+		else if (phase == "nonreader" && elapsed_ms / 10 >= progress[i])
+			chunk = "WHO #crowd\r\n";
+		if (chunk.empty())
+			continue;
+		a.outbuf = chunk;
+		progress[i] += phase == "nonreader" ? 1 : chunk.size();
+		bytes += chunk.size();
+	}
+	benchPoll(attackers, 0);
+	for (std::size_t i = 0; i < attackers.size(); ++i)
+		if (!attackers[i].no_read)
+			attackers[i].inbuf.clear();
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+	std::vector<std::string> out;
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ','))
+		if (!item.empty())
+			out.push_back(item);
+	return out;
+}
+
+}
+
+int runAttack(const BenchOptions& opts) {
+	std::size_t legit_count = static_cast<std::size_t>(opts.getLong("legit", 20));
+	double rate = opts.getDouble("rate", 200.0);
+	double phase_s = opts.getDouble("phase-duration", 5.0);
+	long settle_ms = opts.getLong("settle-ms", 1000);
+	AttackConfig cfg;
+	cfg.idle_conns = static_cast<std::size_t>(opts.getLong("idle-conns", 2000));
+	cfg.slow_conns = static_cast<std::size_t>(opts.getLong("slow-conns", 500));
+	cfg.flood_conns = static_cast<std::size_t>(opts.getLong("flood-conns", 10));
+	cfg.flood_size = static_cast<std::size_t>(opts.getLong("flood-size", 2000));
+	cfg.spam_conns = static_cast<std::size_t>(opts.getLong("spam-conns", 10));
+	cfg.nonreaders = static_cast<std::size_t>(opts.getLong("nonreaders", 10));
+	cfg.crowd = static_cast<std::size_t>(opts.getLong("crowd", 300));
+	std::vector<std::string> phases = splitList(opts.get("phases", "baseline,idle,slowloris,oversized,unknown,nonreader"));
+	std::mt19937 rng(static_cast<unsigned>(opts.getLong("seed", 42)));
+	if (legit_count < 2 || rate <= 0) {
+		std::cerr << "attack: need --legit >= 2 and --rate > 0\n";
+		return 1;
+	}
+
+	long fd_limit = benchRaiseFdLimit();
+	BenchTarget target;
+	if (!benchOpenTarget(opts, target)) {
+		std::cerr << "attack: could not start server\n";
+		return 1;
+	}
+	std::vector<BenchConn> legit;
+	if (!benchConnectAll(target, "legit", legit_count, legit)) {
+		std::cerr << "attack: legit clients could not register\n";
+		benchCloseTarget(target);
+		return 1;
+	}
+	for (std::size_t i = 0; i < legit.size(); ++i)
+		benchQueue(legit[i], "JOIN #legit");
+	benchWaitNumeric(legit, "366", std::vector<int>(legit.size(), 1), 30000);
+
+	std::vector<PhaseResult> results(phases.size());
+	for (std::size_t p = 0; p < phases.size(); ++p) {
+		PhaseResult& r = results[p];
+		r.name = phases[p];
+		r.rss_start_kb = benchRssKb(target.pid);
+		std::vector<BenchConn> attackers;
+		std::vector<BenchConn> crowd;
+		if (!setupAttackers(r.name, target, cfg, attackers, crowd))
+			std::cerr << "attack: phase " << r.name << ": attackers only partly connected\n";
+		r.attackers = attackers.size();
+		std::vector<std::size_t> progress(attackers.size(), 0);
+
+		std::uint64_t start = benchNowNs();
+		std::uint64_t stop = start + static_cast<std::uint64_t>(phase_s * 1e9);
+		std::uint64_t last_rss = 0;
+		for (std::uint64_t now = start; now < stop; now = benchNowNs()) {
+			pumpLegit(legit, r, start, rate, rng);
+			driveAttackers(r.name, cfg, attackers, progress, start, r.attack_bytes);
+			if (!crowd.empty()) {
+				benchPoll(crowd, 0);
+				for (std::size_t i = 0; i < crowd.size(); ++i)
+					crowd[i].inbuf.clear();
+			}
+			if (now - last_rss > 100000000ull) {
+				r.rss_peak_kb = std::max(r.rss_peak_kb, benchRssKb(target.pid));
+				last_rss = now;
+			}
+		}
+		// late deliveries still count toward the phase
+		std::uint64_t drain = benchNowNs() + 2000000000ull;
+		while (r.delivered < r.expected && benchNowNs() < drain)
+			pumpLegit(legit, r, benchNowNs() + 1000000000ull, 0.0, rng);
+		r.rss_peak_kb = std::max(r.rss_peak_kb, benchRssKb(target.pid));
+		for (std::size_t i = 0; i < attackers.size(); ++i) {
+			if (!attackers[i].no_read)
+				benchRead(attackers[i]);
+			r.attackers_dropped += attackers[i].closed ? 1 : 0;
+			benchClose(attackers[i]);
+		}
+		for (std::size_t i = 0; i < crowd.size(); ++i)
+			benchClose(crowd[i]);
+		std::uint64_t settle = benchNowNs() + static_cast<std::uint64_t>(settle_ms) * 1000000ull;
+		while (benchNowNs() < settle)
+			benchPoll(legit, 10);
+		r.rss_settled_kb = benchRssKb(target.pid);
+	}
+	for (std::size_t i = 0; i < legit.size(); ++i)
+		benchClose(legit[i]);
+	benchCloseTarget(target);
+
+	JsonWriter json;
+	json.beginObject();
+	json.field("mode", "attack");
+	json.field("legit_clients", static_cast<std::uint64_t>(legit_count));
+	json.field("rate", rate);
+	json.field("phase_duration_s", phase_s);
+	json.field("fd_limit", fd_limit);
+	json.beginArray("phases");
+	for (std::size_t p = 0; p < results.size(); ++p) {
+		PhaseResult& r = results[p];
+		json.beginObject();
+		json.field("name", r.name);
+		json.field("attackers", static_cast<std::uint64_t>(r.attackers));
+		json.field("attackers_dropped", static_cast<std::uint64_t>(r.attackers_dropped));
+		json.field("attack_bytes", r.attack_bytes);
+		json.field("legit_sent", r.sent);
+		json.field("legit_expected", r.expected);
+		json.field("legit_delivered", r.delivered);
+		json.beginObject("legit_latency_us");
+		json.field("p50", static_cast<double>(r.latency.percentile(0.50)) / 1e3);
+		json.field("p99", static_cast<double>(r.latency.percentile(0.99)) / 1e3);
+		json.field("p999", static_cast<double>(r.latency.percentile(0.999)) / 1e3);
+		json.field("max", static_cast<double>(r.latency.max()) / 1e3);
+		json.endObject();
+		json.beginObject("server_rss_kb");
+		json.field("start", r.rss_start_kb);
+		json.field("peak", r.rss_peak_kb);
+		json.field("settled", r.rss_settled_kb);
+		json.endObject();
+		json.endObject();
+	}
+	json.endArray();
+	json.endObject();
+	if (opts.has("json"))
+		benchWriteFile(opts.get("json", ""), json.str());
+	std::cout << json.str() << std::endl;
+	return 0;
+}
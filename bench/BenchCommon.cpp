@@ -0,0 +1,460 @@
+/**
+ * @brief Shared helpers for the ircbench load tool
+ */
+
+#include "BenchCommon.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+std::uint64_t benchNowNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+// = BenchOptions =
+
+BenchOptions::BenchOptions(int ac, char** av, int first) {
+	for (int i = first; i < ac; ++i) {
+		std::string arg = av[i];
+		if (arg.compare(0, 2, "--") != 0)
+			continue;
+		std::string key = arg.substr(2);
+		if (i + 1 < ac && std::strncmp(av[i + 1], "--", 2) != 0)
+			m_values[key] = av[++i];
+		else
+			m_values[key] = "1";
+	}
+}
+
+bool BenchOptions::has(const std::string& key) const { return m_values.count(key) != 0; }
+
+std::string BenchOptions::get(const std::string& key, const std::string& def) const {
+	std::map<std::string, std::string>::const_iterator it = m_values.find(key);
+	return it == m_values.end() ? def : it->second;
+}
+
+long BenchOptions::getLong(const std::string& key, long def) const {
+	return has(key) ? std::strtol(get(key, "").c_str(), NULL, 10) : def;
+}
+
+double BenchOptions::getDouble(const std::string& key, double def) const {
+	return has(key) ? std::strtod(get(key, "").c_str(), NULL) : def;
+}
+
+// = Connections =
+
+BenchConn::BenchConn()
+	: fd(-1), nick(), inbuf(), outbuf(), registered(false), closed(false), no_read(false), channels()
+{}
+
+/*
+	Blocking connect to host:port (loopback, so it completes immediately), then switch to non-blocking.
+	source_ip binds the local end first: 127.0.0.x aliases give each source address its own
+	ephemeral port range, needed for more than ~28k connections.
+*/
+int benchConnect(const std::string& host, int port, const std::string& source_ip) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (!source_ip.empty()) {
+		sockaddr_in local;
+		std::memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_port = 0;
+		inet_pton(AF_INET, source_ip.c_str(), &local.sin_addr);
+		if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0) {
+			close(fd);
+			return -1;
+		}
+	}
+	sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<unsigned short>(port));
+	if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+		connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	return fd;
+}
+
+void benchQueue(BenchConn& conn, const std::string& line) {
+	conn.outbuf += line;
+	conn.outbuf += "\r\n";
+}
+
+bool benchFlush(BenchConn& conn) {
+	while (!conn.outbuf.empty() && !conn.closed) {
+		ssize_t n = send(conn.fd, conn.outbuf.data(), conn.outbuf.size(), MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			if (errno == EINTR)
+				continue;
+			conn.closed = true;
+			return false;
+		}
+		conn.outbuf.erase(0, static_cast<std::size_t>(n));
+	}
+	return !conn.closed;
+}
+
+bool benchRead(BenchConn& conn) {
+	char buf[65536];
+	while (!conn.closed) {
+		ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+		if (n > 0) {
+			conn.inbuf.append(buf, static_cast<std::size_t>(n));
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		if (n < 0 && errno == EINTR)
+			continue;
+		conn.closed = true;
+	}
+	return false;
+}
+
+bool benchNextLine(BenchConn& conn, std::string& line) {
+	std::size_t pos = conn.inbuf.find('\n');
+	if (pos == std::string::npos)
+		return false;
+	std::size_t end = (pos > 0 && conn.inbuf[pos - 1] == '\r') ? pos - 1 : pos;
+	line.assign(conn.inbuf, 0, end);
+	conn.inbuf.erase(0, pos + 1);
+	return true;
+}
+
+void benchRegister(BenchConn& conn, const std::string& password) {
+	benchQueue(conn, "PASS " + password);
+	benchQueue(conn, "NICK " + conn.nick);
+	benchQueue(conn, "USER " + conn.nick + " 0 * :ircbench " + conn.nick);
+}
+
+void benchClose(BenchConn& conn) {
+	if (conn.fd >= 0)
+		close(conn.fd);
+	conn.fd = -1;
+	conn.closed = true;
+}
+
+/*
+	One poll() round over all open connections: POLLOUT only when output is pending,
+	ready sockets are flushed and drained into their inbuf. Returns the number of ready fds.
+*/
+int benchPoll(std::vector<BenchConn>& conns, int timeout_ms) {
+	std::vector<pollfd> fds;
+	std::vector<std::size_t> index;
+	fds.reserve(conns.size());
+	index.reserve(conns.size());
+	for (std::size_t i = 0; i < conns.size(); ++i) {
+		if (conns[i].closed)
+			continue;
+		pollfd p;
+		p.fd = conns[i].fd;
+		p.events = conns[i].no_read ? 0 : POLLIN;
+		if (!conns[i].outbuf.empty())
+			p.events |= POLLOUT;
+		p.revents = 0;
+		fds.push_back(p);
+		index.push_back(i);
+	}
+	if (fds.empty())
+		return 0;
+	int ready = poll(&fds[0], fds.size(), timeout_ms);
+	if (ready <= 0)
+		return 0;
+	for (std::size_t i = 0; i < fds.size(); ++i) {
+		BenchConn& conn = conns[index[i]];
+		if (fds[i].revents & POLLOUT)
+			benchFlush(conn);
+		if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+			benchRead(conn);
+	}
+	return ready;
+}
+
+// Wait until every connection saw `numeric` `want[i]` times; false on timeout or broken connection
+bool benchWaitNumeric(std::vector<BenchConn>& conns, const std::string& numeric,
+	const std::vector<int>& want, long timeout_ms) {
+	std::vector<int> seen(conns.size(), 0);
+	std::size_t done = 0;
+	for (std::size_t i = 0; i < conns.size(); ++i)
+		if (want[i] == 0)
+			++done;
+	std::uint64_t deadline = benchNowNs() + static_cast<std::uint64_t>(timeout_ms) * 1000000ull;
+	std::string line;
+	std::string needle = " " + numeric + " ";
+	while (done < conns.size()) {
+		if (benchNowNs() > deadline)
+			return false;
+		benchPoll(conns, 10);
+		for (std::size_t i = 0; i < conns.size(); ++i) {
+			if (conns[i].closed)
+				return false;
+			while (benchNextLine(conns[i], line)) {
+				if (line.find(needle) != std::string::npos && ++seen[i] == want[i])
+					++done;
+				if (line.compare(0, 5, "PING ") == 0)
+					benchQueue(conns[i], "PONG " + line.substr(5));
+			}
+		}
+	}
+	return true;
+}
+
+// = LatencySamples =
+
+LatencySamples::LatencySamples() : m_samples(), m_sorted(true) {}
+
+void LatencySamples::add(std::uint64_t ns) {
+	m_samples.push_back(ns);
+	m_sorted = false;
+}
+
+std::size_t LatencySamples::count() const { return m_samples.size(); }
+
+std::uint64_t LatencySamples::percentile(double p) {
+	if (m_samples.empty())
+		return 0;
+	if (!m_sorted) {
+		std::sort(m_samples.begin(), m_samples.end());
+		m_sorted = true;
+	}
+	std::size_t idx = static_cast<std::size_t>(p * static_cast<double>(m_samples.size()));
+	if (idx >= m_samples.size())
+		idx = m_samples.size() - 1;
+	return m_samples[idx];
+}
+
+std::uint64_t LatencySamples::max() { return percentile(1.0); }
+
+void LatencySamples::clear() {
+	m_samples.clear();
+	m_sorted = true;
+}
+
+// = JsonWriter =
+
+JsonWriter::JsonWriter() : m_out(), m_first() {}
+
+void JsonWriter::separator() {
+	if (m_first.empty())
+		return;
+	if (!m_first.back())
+		m_out += ",";
+	m_first.back() = false;
+}
+
+void JsonWriter::key(const std::string& k) {
+	separator();
+	if (!k.empty()) {
+		m_out += "\"";
+		m_out += k;
+		m_out += "\":";
+	}
+}
+
+void JsonWriter::beginObject(const std::string& k) {
+	key(k);
+	m_out += "{";
+	m_first.push_back(true);
+}
+
+void JsonWriter::endObject() {
+	m_out += "}";
+	m_first.pop_back();
+}
+
+void JsonWriter::beginArray(const std::string& k) {
+	key(k);
+	m_out += "[";
+	m_first.push_back(true);
+}
+
+void JsonWriter::endArray() {
+	m_out += "]";
+	m_first.pop_back();
+}
+
+void JsonWriter::field(const std::string& k, const std::string& v) {
+	key(k);
+	m_out += "\"";
+	for (std::size_t i = 0; i < v.size(); ++i) {
+		unsigned char c = static_cast<unsigned char>(v[i]);
+		if (c == '"' || c == '\\') {
+			m_out += '\\';
+			m_out += static_cast<char>(c);
+		} else if (c < 0x20) {
+			char buf[8];
+			std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+			m_out += buf;
+		} else
+			m_out += static_cast<char>(c);
+	}
+	m_out += "\"";
+}
+
+void JsonWriter::field(const std::string& k, const char* v) { field(k, std::string(v)); }
+
+void JsonWriter::field(const std::string& k, double v) {
+	key(k);
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "%.3f", v);
+	m_out += buf;
+}
+
+void JsonWriter::field(const std::string& k, std::uint64_t v) {
+	key(k);
+	m_out += std::to_string(v);
+}
+
+void JsonWriter::field(const std::string& k, long v) {
+	key(k);
+	m_out += std::to_string(v);
+}
+
+void JsonWriter::field(const std::string& k, int v) { field(k, static_cast<long>(v)); }
+
+void JsonWriter::field(const std::string& k, bool v) {
+	key(k);
+	m_out += v ? "true" : "false";
+}
+
+const std::string& JsonWriter::str() const { return m_out; }
+
+bool benchWriteFile(const std::string& path, const std::string& data) {
+	std::ofstream out(path.c_str());
+	out << data << "\n";
+	return static_cast<bool>(out);
+}
+
+// = Server process =
+
+// Called before spawning, so a spawned server inherits the raised limit too
+long benchRaiseFdLimit() {
+	rlimit lim;
+	if (getrlimit(RLIMIT_NOFILE, &lim) < 0)
+		return -1;
+	lim.rlim_cur = lim.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &lim);
+	getrlimit(RLIMIT_NOFILE, &lim);
+	return static_cast<long>(lim.rlim_cur);
+}
+
+/*
+	fork/exec the server binary, then poll its port until connect() succeeds (max ~5 s).
+	stdout is silenced, stderr (logger) is kept for diagnostics.
+*/
+pid_t benchSpawnServer(const std::string& binary, int port, const std::string& password) {
+	pid_t pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		int devnull = open("/dev/null", O_WRONLY);
+		if (devnull >= 0)
+			dup2(devnull, STDOUT_FILENO);
+		std::string port_str = std::to_string(port);
+		execl(binary.c_str(), binary.c_str(), port_str.c_str(), password.c_str(), static_cast<char*>(NULL));
+		_exit(127);
+	}
+	for (int i = 0; i < 500; ++i) {
+		int fd = benchConnect("127.0.0.1", port);
+		if (fd >= 0) {
+			close(fd);
+			return pid;
+		}
+		int status;
+		if (waitpid(pid, &status, WNOHANG) == pid)
+			return -1;
+		usleep(10000);
+	}
+	benchStopServer(pid);
+	return -1;
+}
+
+void benchStopServer(pid_t pid) {
+	if (pid <= 0)
+		return;
+	kill(pid, SIGTERM);
+	for (int i = 0; i < 300; ++i) {
+		int status;
+		if (waitpid(pid, &status, WNOHANG) == pid)
+			return;
+		usleep(10000);
+	}
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+}
+
+long benchRssKb(pid_t pid) {
+	if (pid <= 0)
+		return -1;
+	std::ifstream status(("/proc/" + std::to_string(pid) + "/status").c_str());
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmRSS:") == 0)
+			return std::strtol(line.c_str() + 6, NULL, 10);
+	}
+	return -1;
+}
+
+bool benchOpenTarget(const BenchOptions& opts, BenchTarget& target) {
+	target.host = opts.get("host", "127.0.0.1");
+	target.port = static_cast<int>(opts.getLong("port", 6667));
+	target.password = opts.get("password", "benchpass");
+	target.pid = static_cast<pid_t>(opts.getLong("server-pid", -1));
+	target.spawned = false;
+	if (opts.has("spawn")) {
+		target.pid = benchSpawnServer(opts.get("spawn", "./ircserv"), target.port, target.password);
+		if (target.pid < 0)
+			return false;
+		target.spawned = true;
+	}
+	return true;
+}
+
+void benchCloseTarget(BenchTarget& target) {
+	if (target.spawned)
+		benchStopServer(target.pid);
+	target.spawned = false;
+}
+
+bool benchConnectAll(const BenchTarget& target, const std::string& nick_prefix,
+	std::size_t count, std::vector<BenchConn>& conns, long timeout_ms) {
+	conns.assign(count, BenchConn());
+	for (std::size_t i = 0; i < count; ++i) {
+		conns[i].fd = benchConnect(target.host, target.port);
+		if (conns[i].fd < 0)
+			return false;
+		conns[i].nick = nick_prefix + std::to_string(i);
+		benchRegister(conns[i], target.password);
+	}
+	if (!benchWaitNumeric(conns, "001", std::vector<int>(count, 1), timeout_ms))
+		return false;
+	for (std::size_t i = 0; i < count; ++i)
+		conns[i].registered = true;
+	return true;
+}
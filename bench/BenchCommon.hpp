@@ -0,0 +1,121 @@
+#ifndef BENCHCOMMON_HPP
+#define BENCHCOMMON_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @brief Shared helpers for the ircbench load tool
+ * 
+ * Loopback IRC connections with line buffering, latency sample sets,
+ * a minimal JSON writer, command line options and server process control
+ * (spawn + RSS sampling through /proc).
+ */
+
+// Monotonic clock in nanoseconds (CLOCK_MONOTONIC is shared by all processes on the host)
+std::uint64_t	benchNowNs();
+
+// = Command line: "--key value" pairs and bare "--flag" =
+class BenchOptions {
+	private:
+			std::map<std::string, std::string>	m_values;
+
+	public:
+			BenchOptions(int ac, char** av, int first);
+			bool			has(const std::string& key) const;
+			std::string		get(const std::string& key, const std::string& def) const;
+			long			getLong(const std::string& key, long def) const;
+			double			getDouble(const std::string& key, double def) const;
+};
+
+// = One IRC connection driven by a poll() loop =
+struct BenchConn {
+	int				fd;
+	std::string		nick;
+	std::string		inbuf;
+	std::string		outbuf;
+	bool			registered;
+	bool			closed;
+	bool			no_read;			// never poll for input (attacker that lets the server's queue grow)
+	std::vector<std::string>	channels;
+
+	BenchConn();
+};
+
+int			benchConnect(const std::string& host, int port, const std::string& source_ip = "");	// non-blocking fd, -1 on error
+void		benchQueue(BenchConn& conn, const std::string& line);								// appends "\r\n"
+bool		benchFlush(BenchConn& conn);														// false if the connection broke
+bool		benchRead(BenchConn& conn);															// false on EOF/error
+bool		benchNextLine(BenchConn& conn, std::string& line);									// pops one line without CRLF
+void		benchRegister(BenchConn& conn, const std::string& password);						// queue PASS/NICK/USER
+void		benchClose(BenchConn& conn);
+int			benchPoll(std::vector<BenchConn>& conns, int timeout_ms);							// one poll() round: flush + read all ready
+bool		benchWaitNumeric(std::vector<BenchConn>& conns, const std::string& numeric,			// until conn i saw `numeric` want[i] times
+				const std::vector<int>& want, long timeout_ms);
+
+// = Latency samples (nanoseconds) =
+class LatencySamples {
+	private:
+			std::vector<std::uint64_t>	m_samples;
+			bool						m_sorted;
+
+	public:
+			LatencySamples();
+			void			add(std::uint64_t ns);
+			std::size_t		count() const;
+			std::uint64_t	percentile(double p);			// p in 0..1
+			std::uint64_t	max();
+			void			clear();
+};
+
+// = Minimal JSON writer (objects, arrays, scalars) =
+class JsonWriter {
+	private:
+			std::string			m_out;
+			std::vector<bool>	m_first;				// per nesting level: no element written yet
+
+			void	separator();
+			void	key(const std::string& k);
+
+	public:
+			JsonWriter();
+			void	beginObject(const std::string& k = "");
+			void	endObject();
+			void	beginArray(const std::string& k = "");
+			void	endArray();
+			void	field(const std::string& k, const std::string& v);
+			void	field(const std::string& k, const char* v);
+			void	field(const std::string& k, double v);
+			void	field(const std::string& k, std::uint64_t v);
+			void	field(const std::string& k, long v);
+			void	field(const std::string& k, int v);
+			void	field(const std::string& k, bool v);
+			const std::string&	str() const;
+};
+
+bool		benchWriteFile(const std::string& path, const std::string& data);
+
+// = Server process =
+long		benchRaiseFdLimit();																// soft RLIMIT_NOFILE -> hard, returns new limit
+pid_t		benchSpawnServer(const std::string& binary, int port, const std::string& password);	// waits until the port accepts
+void		benchStopServer(pid_t pid);
+long		benchRssKb(pid_t pid);																// VmRSS, -1 if unknown
+
+// = Server under test: --spawn <binary> starts a private instance, otherwise --host/--port =
+struct BenchTarget {
+	std::string		host;
+	int				port;
+	std::string		password;
+	pid_t			pid;				// server pid for RSS sampling (--server-pid or spawned), -1 if unknown
+	bool			spawned;
+};
+
+bool		benchOpenTarget(const BenchOptions& opts, BenchTarget& target);
+bool		benchConnectAll(const BenchTarget& target, const std::string& nick_prefix,			// connect + register, nicks prefix0..N-1
+				std::size_t count, std::vector<BenchConn>& conns, long timeout_ms = 30000);
+void		benchCloseTarget(BenchTarget& target);
+
+#endif
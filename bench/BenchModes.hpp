@@ -0,0 +1,18 @@
+#ifndef BENCHMODES_HPP
+#define BENCHMODES_HPP
+
+#include "BenchCommon.hpp"
+
+/**
+ * @brief Entry points of the ircbench sub-commands
+ * 
+ * Each mode parses its own "--key value" options and returns the process exit code.
+ */
+
+int		runLoad(const BenchOptions& opts);
+int		runReplay(const BenchOptions& opts);
+int		runAttack(const BenchOptions& opts);
+int		runScale(const BenchOptions& opts);
+int		runProbe(const BenchOptions& opts);
+
+#endif
@@ -0,0 +1,185 @@
+/**
+ * @brief In-process harness: the full command pipeline without TCP
+ * 
+ * Builds a listener-less Server, attaches --clients synthetic clients as socketpair()
+ * ends (Server::attachClient) and drives the loop with Server::runOnce(0), so every
+ * message goes receiveData -> handleCommand -> sendData exactly as in production but
+ * nothing crosses the loopback TCP stack. Only time spent inside runOnce() is counted
+ * as server time, which makes CPU profiles of the pipeline (perf record -- bench/inproc)
+ * reproducible.
+ * 
+ * Usage: inproc [--clients N] [--channels M] [--rounds R] [--senders S] [--msg-size B]
+ *               [--script <file>] [--json <file>]
+ * 
+ * --script replaces the built-in chat rounds with lines "<client-index> <raw IRC line>",
+ * sent in order (clients are registered as b<index> and joined beforehand).
+ */
+
+#include "BenchCommon.hpp"
+#include "network/Server.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+struct Harness {
+	Server&					server;
+	std::vector<BenchConn>	conns;				// harness side of each socketpair
+	std::uint64_t			server_ns;			// time spent inside Server::runOnce()
+	std::uint64_t			iterations;
+	std::uint64_t			bytes_in;			// bytes read back by the synthetic clients
+
+	explicit Harness(Server& s) : server(s), conns(), server_ns(0), iterations(0), bytes_in(0) {}
+
+	// Run the server until it goes idle, draining client ends in between
+	void pump() {
+		for (int idle = 0; idle < 2; ) {
+			std::uint64_t t0 = benchNowNs();
+			int ready = server.runOnce(0);
+			server_ns += benchNowNs() - t0;
+			++iterations;
+			bool moved = ready > 0;
+			for (std::size_t i = 0; i < conns.size(); ++i) {
+				std::size_t before = conns[i].inbuf.size();
+				benchFlush(conns[i]);
+				benchRead(conns[i]);
+				bytes_in += conns[i].inbuf.size() - before;
+				moved = moved || conns[i].inbuf.size() != before || !conns[i].outbuf.empty();
+			}
+			idle = moved ? 0 : idle + 1;
+		}
+	}
+
+	// Count lines containing `needle` on every connection, then drop the read data
+	std::size_t countAndClear(const std::string& needle) {
+		std::size_t count = 0;
+		std::string line;
+		for (std::size_t i = 0; i < conns.size(); ++i) {
+			while (benchNextLine(conns[i], line))
+				if (line.find(needle) != std::string::npos)
+					++count;
+		}
+		return count;
+	}
+};
+
+}
+
+int main(int ac, char* av[]) {
+	BenchOptions opts(ac, av, 1);
+	std::size_t clients = static_cast<std::size_t>(opts.getLong("clients", 1000));
+	std::size_t channels = static_cast<std::size_t>(opts.getLong("channels", 50));
+	std::size_t rounds = static_cast<std::size_t>(opts.getLong("rounds", 200));
+	std::size_t senders = static_cast<std::size_t>(opts.getLong("senders", 50));
+	std::size_t msg_size = static_cast<std::size_t>(opts.getLong("msg-size", 64));
+	const std::string password = "inproc";
+	if (clients < 2 || channels < 1 || senders < 1) {
+		std::cerr << "inproc: need --clients >= 2, --channels >= 1 and --senders >= 1\n";
+		return 1;
+	}
+
+	Server server(password);
+	Harness h(server);
+	h.conns.resize(clients);
+	for (std::size_t i = 0; i < clients; ++i) {
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 || !server.attachClient(sv[0])) {
+			std::perror("inproc: socketpair");
+			return 1;
+		}
+		fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL, 0) | O_NONBLOCK);
+		h.conns[i].fd = sv[1];
+		h.conns[i].nick = "b" + std::to_string(i);
+		benchRegister(h.conns[i], password);
+	}
+
+	// = Registration and joins (timed separately) =
+	h.pump();
+	std::size_t welcomed = h.countAndClear(" 001 ");
+	std::uint64_t register_ns = h.server_ns;
+	std::vector<std::size_t> channel_size(channels, 0);
+	for (std::size_t i = 0; i < clients; ++i) {
+		std::string name = "#bench" + std::to_string(i % channels);
+		benchQueue(h.conns[i], "JOIN " + name);
+		h.conns[i].channels.push_back(name);
+		++channel_size[i % channels];
+	}
+	h.pump();
+	h.countAndClear(" 366 ");
+	std::uint64_t join_ns = h.server_ns - register_ns;
+
+	// = Traffic =
+	h.server_ns = 0;
+	h.iterations = 0;
+	h.bytes_in = 0;
+	std::uint64_t inbound = 0;
+	std::uint64_t expected = 0;
+	if (opts.has("script")) {
+		std::ifstream script(opts.get("script", "").c_str());
+		std::string line;
+		while (std::getline(script, line)) {
+			std::size_t sp = line.find(' ');
+			if (line.empty() || line[0] == '#' || sp == std::string::npos)
+				continue;
+			std::size_t idx = static_cast<std::size_t>(std::strtoul(line.c_str(), NULL, 10));
+			if (idx >= clients)
+				continue;
+			benchQueue(h.conns[idx], line.substr(sp + 1));
+			++inbound;
+			if (inbound % senders == 0) {
+				h.pump();
+				h.countAndClear("\n");
+			}
+		}
+		h.pump();
+		h.countAndClear("\n");
+	} else {
+		std::mt19937 rng(static_cast<unsigned>(opts.getLong("seed", 42)));
+		std::uniform_int_distribution<std::size_t> pick(0, clients - 1);
+		std::string pad(msg_size, 'x');
+		std::size_t delivered = 0;
+		for (std::size_t r = 0; r < rounds; ++r) {
+			for (std::size_t s = 0; s < senders; ++s) {
+				std::size_t from = pick(rng);
+				benchQueue(h.conns[from], "PRIVMSG " + h.conns[from].channels[0] + " :" + pad);
+				expected += channel_size[from % channels] - 1;
+				++inbound;
+			}
+			h.pump();
+			delivered += h.countAndClear(" PRIVMSG ");
+		}
+		if (delivered != expected)
+			std::cerr << "inproc: delivered " << delivered << " of " << expected << " copies\n";
+	}
+
+	double server_s = static_cast<double>(h.server_ns) / 1e9;
+	JsonWriter json;
+	json.beginObject();
+	json.field("mode", "inproc");
+	json.field("clients", static_cast<std::uint64_t>(clients));
+	json.field("channels", static_cast<std::uint64_t>(channels));
+	json.field("registered", static_cast<std::uint64_t>(welcomed));
+	json.field("register_us_per_client", static_cast<double>(register_ns) / 1e3 / static_cast<double>(clients));
+	json.field("join_us_per_client", static_cast<double>(join_ns) / 1e3 / static_cast<double>(clients));
+	json.field("inbound_msgs", inbound);
+	json.field("expected_copies", expected);
+	json.field("outbound_bytes", h.bytes_in);
+	json.field("server_s", server_s);
+	json.field("loop_iterations", h.iterations);
+	json.field("ns_per_inbound_msg", inbound ? static_cast<double>(h.server_ns) / static_cast<double>(inbound) : 0.0);
+	json.field("ns_per_copy", expected ? static_cast<double>(h.server_ns) / static_cast<double>(expected) : 0.0);
+	json.field("inbound_msgs_per_s", server_s > 0 ? static_cast<double>(inbound) / server_s : 0.0);
+	json.endObject();
+	if (opts.has("json"))
+		benchWriteFile(opts.get("json", ""), json.str());
+	std::cout << json.str() << std::endl;
+
+	for (std::size_t i = 0; i < clients; ++i)
+		benchClose(h.conns[i]);
+	return 0;
+}
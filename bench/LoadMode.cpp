@@ -0,0 +1,252 @@
+#include "BenchModes.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+/**
+ * @brief "load" mode: throughput / end-to-end latency under channel fan-out
+ * 
+ * 1. connect and register --clients connections (PASS/NICK/USER, wait for 001)
+ * 2. every client joins --joins channels out of --channels, picked by --dist:
+ *      uniform  - round robin, all channels the same size
+ *      zipf     - channel k weighted 1/(k+1)^s (--zipf-s), a few big channels and a long tail
+ *      single   - everyone in one channel (--channels is ignored)
+ * 3. for --duration seconds a random member sends PRIVMSG to one of its channels, --rate
+ *    messages/s in total; the payload carries the send timestamp so every receiver
+ *    measures delivery latency against the same monotonic clock; with --query-every N
+ *    every Nth message is followed by a WHO / NAMES (alternating) on the same channel
+ * 4. drain until every expected copy arrived (or --drain-ms), report JSON
+ */
+
+namespace {
+
+struct LoadStats {
+	std::uint64_t	sent;
+	std::uint64_t	expected;			// sum over sent messages of (channel size - 1)
+	std::uint64_t	delivered;
+	std::uint64_t	bytes_sent;
+	std::uint64_t	queries;			// WHO / NAMES sent (--query-every)
+	LatencySamples	latency;
+	long			rss_peak_kb;
+
+	LoadStats() : sent(0), expected(0), delivered(0), bytes_sent(0), queries(0), latency(), rss_peak_kb(-1) {}
+};
+
+// Channel index for each (client, join) pair according to the distribution
+std::vector<std::vector<int> > assignChannels(const BenchOptions& opts, std::size_t clients,
+	int channels, int joins, std::mt19937& rng) {
+	std::string dist = opts.get("dist", "uniform");
+	std::vector<std::vector<int> > result(clients);
+	if (dist == "single") {
+		for (std::size_t i = 0; i < clients; ++i)
+			result[i].push_back(0);
+		return result;
+	}
+	std::vector<double> weights(static_cast<std::size_t>(channels), 1.0);
+	if (dist == "zipf") {
+		double s = opts.getDouble("zipf-s", 1.0);
+		for (int k = 0; k < channels; ++k)
+			weights[static_cast<std::size_t>(k)] = 1.0 / std::pow(static_cast<double>(k + 1), s);
+	}
+	std::discrete_distribution<int> pick(weights.begin(), weights.end());
+	for (std::size_t i = 0; i < clients; ++i) {
+		for (int j = 0; j < joins && j < channels; ++j) {
+			int chan;
+			if (dist == "uniform")
+				chan = static_cast<int>((i * static_cast<std::size_t>(joins) + static_cast<std::size_t>(j)) % static_cast<std::size_t>(channels));
+			else {
+				bool dup;
+				do {
+					chan = pick(rng);
+					dup = false;
+					for (std::size_t k = 0; k < result[i].size(); ++k)
+						dup = dup || result[i][k] == chan;
+				} while (dup);
+			}
+			result[i].push_back(chan);
+		}
+	}
+	return result;
+}
+
+// "PRIVMSG #chan :BENCH <send_ns> <seq> xxxx" -> latency sample for this receiver
+void handleLine(const std::string& line, BenchConn& conn, LoadStats& stats, bool measure) {
+	std::size_t pos = line.find(" :BENCH ");
+	if (pos != std::string::npos && line.find(" PRIVMSG ") != std::string::npos) {
+		std::uint64_t stamp = std::strtoull(line.c_str() + pos + 8, NULL, 10);
+		++stats.delivered;
+		if (measure)
+			stats.latency.add(benchNowNs() - stamp);
+	} else if (line.compare(0, 5, "PING ") == 0)
+		benchQueue(conn, "PONG " + line.substr(5));
+}
+
+}
+
+int runLoad(const BenchOptions& opts) {
+	std::size_t clients = static_cast<std::size_t>(opts.getLong("clients", 100));
+	int channels = static_cast<int>(opts.getLong("channels", 10));
+	int joins = static_cast<int>(opts.getLong("joins", 1));
+	double rate = opts.getDouble("rate", 1000.0);
+	double duration = opts.getDouble("duration", 10.0);
+	double warmup = opts.getDouble("warmup", 1.0);
+	std::size_t msg_size = static_cast<std::size_t>(opts.getLong("msg-size", 64));
+	long drain_ms = opts.getLong("drain-ms", 5000);
+	std::uint64_t query_every = static_cast<std::uint64_t>(opts.getLong("query-every", 0));
+	std::mt19937 rng(static_cast<unsigned>(opts.getLong("seed", 42)));
+	if (opts.get("dist", "uniform") == "single")
+		channels = 1;
+	if (clients < 2 || channels < 1 || joins < 1 || rate <= 0) {
+		std::cerr << "load: need --clients >= 2, --channels >= 1, --joins >= 1, --rate > 0\n";
+		return 1;
+	}
+
+	BenchTarget target;
+	if (!benchOpenTarget(opts, target)) {
+		std::cerr << "load: could not start server\n";
+		return 1;
+	}
+	long rss_start_kb = benchRssKb(target.pid);
+
+	// = Connect and register =
+	std::uint64_t t0 = benchNowNs();
+	std::vector<BenchConn> conns;
+	if (!benchConnectAll(target, "b", clients, conns)) {
+		std::cerr << "load: connect/registration failed\n";
+		benchCloseTarget(target);
+		return 1;
+	}
+	double register_s = static_cast<double>(benchNowNs() - t0) / 1e9;
+
+	// = Join channels =
+	std::vector<std::vector<int> > membership = assignChannels(opts, clients, channels, joins, rng);
+	std::vector<std::size_t> channel_size(static_cast<std::size_t>(channels), 0);
+	std::vector<int> join_count(clients, 0);
+	for (std::size_t i = 0; i < clients; ++i) {
+		for (std::size_t j = 0; j < membership[i].size(); ++j) {
+			std::string name = "#bench" + std::to_string(membership[i][j]);
+			benchQueue(conns[i], "JOIN " + name);
+			conns[i].channels.push_back(name);
+			++channel_size[static_cast<std::size_t>(membership[i][j])];
+		}
+		join_count[i] = static_cast<int>(membership[i].size());
+	}
+	if (!benchWaitNumeric(conns, "366", join_count, 60000)) {
+		std::cerr << "load: joins did not complete\n";
+		benchCloseTarget(target);
+		return 1;
+	}
+	long rss_ready_kb = benchRssKb(target.pid);
+
+	// = Drive PRIVMSG at the target rate =
+	LoadStats stats;
+	std::string pad(msg_size, 'x');
+	std::uniform_int_distribution<std::size_t> pick_client(0, clients - 1);
+	std::uint64_t start = benchNowNs();
+	std::uint64_t measure_from = start + static_cast<std::uint64_t>(warmup * 1e9);
+	std::uint64_t stop = measure_from + static_cast<std::uint64_t>(duration * 1e9);
+	std::uint64_t sent_measured = 0;
+	std::uint64_t last_rss = 0;
+	std::string line;
+	for (std::uint64_t now = start; now < stop; now = benchNowNs()) {
+		std::uint64_t due = static_cast<std::uint64_t>(static_cast<double>(now - start) / 1e9 * rate);
+		for (; stats.sent < due; ++stats.sent) {
+			std::size_t who = pick_client(rng);
+			BenchConn& from = conns[who];
+			std::size_t c = std::uniform_int_distribution<std::size_t>(0, from.channels.size() - 1)(rng);
+			std::string msg = "PRIVMSG " + from.channels[c] + " :BENCH " + std::to_string(benchNowNs())
+				+ " " + std::to_string(stats.sent) + " " + pad;
+			benchQueue(from, msg);
+			stats.bytes_sent += msg.size() + 2;
+			if (now >= measure_from)
+				++sent_measured;
+			stats.expected += channel_size[static_cast<std::size_t>(membership[who][c])] - 1;
+			if (query_every > 0 && stats.sent % query_every == 0) {
+				std::string query = (stats.queries++ % 2 ? "NAMES " : "WHO ") + from.channels[c];
+				benchQueue(from, query);
+				stats.bytes_sent += query.size() + 2;
+			}
+		}
+		benchPoll(conns, 1);
+		bool measure = now >= measure_from;
+		for (std::size_t i = 0; i < clients; ++i)
+			while (benchNextLine(conns[i], line))
+				handleLine(line, conns[i], stats, measure);
+		if (now - last_rss > 100000000ull) {
+			stats.rss_peak_kb = std::max(stats.rss_peak_kb, benchRssKb(target.pid));
+			last_rss = now;
+		}
+	}
+
+	// = Drain outstanding deliveries =
+	std::uint64_t drain_deadline = benchNowNs() + static_cast<std::uint64_t>(drain_ms) * 1000000ull;
+	while (stats.delivered < stats.expected && benchNowNs() < drain_deadline) {
+		benchPoll(conns, 10);
+		for (std::size_t i = 0; i < clients; ++i)
+			while (benchNextLine(conns[i], line))
+				handleLine(line, conns[i], stats, true);
+	}
+	double elapsed = static_cast<double>(benchNowNs() - measure_from) / 1e9;
+	long rss_end_kb = benchRssKb(target.pid);
+	stats.rss_peak_kb = std::max(stats.rss_peak_kb, rss_end_kb);
+	std::size_t broken = 0;
+	for (std::size_t i = 0; i < clients; ++i) {
+		broken += conns[i].closed ? 1 : 0;
+		benchQueue(conns[i], "QUIT :bench done");
+		benchFlush(conns[i]);
+		benchClose(conns[i]);
+	}
+	benchCloseTarget(target);
+
+	// = Report =
+	std::size_t max_channel = 0;
+	for (std::size_t k = 0; k < channel_size.size(); ++k)
+		max_channel = std::max(max_channel, channel_size[k]);
+	JsonWriter json;
+	json.beginObject();
+	json.field("mode", "load");
+	json.beginObject("config");
+	json.field("clients", static_cast<std::uint64_t>(clients));
+	json.field("channels", channels);
+	json.field("joins_per_client", joins);
+	json.field("dist", opts.get("dist", "uniform"));
+	json.field("rate", rate);
+	json.field("duration_s", duration);
+	json.field("msg_size", static_cast<std::uint64_t>(msg_size));
+	json.field("largest_channel", static_cast<std::uint64_t>(max_channel));
+	json.field("query_every", query_every);
+	json.endObject();
+	json.field("register_s", register_s);
+	json.field("sent", stats.sent);
+	json.field("expected", stats.expected);
+	json.field("delivered", stats.delivered);
+	json.field("queries", stats.queries);
+	json.field("lost", stats.expected > stats.delivered ? stats.expected - stats.delivered : static_cast<std::uint64_t>(0));
+	json.field("broken_connections", static_cast<std::uint64_t>(broken));
+	json.field("send_msgs_per_s", static_cast<double>(sent_measured) / duration);
+	json.field("deliver_msgs_per_s", static_cast<double>(stats.latency.count()) / elapsed);
+	json.field("ingress_bytes_per_s", static_cast<double>(stats.bytes_sent) / (duration + warmup));
+	json.beginObject("latency_us");
+	json.field("samples", static_cast<std::uint64_t>(stats.latency.count()));
+	json.field("p50", static_cast<double>(stats.latency.percentile(0.50)) / 1e3);
+	json.field("p99", static_cast<double>(stats.latency.percentile(0.99)) / 1e3);
+	json.field("p999", static_cast<double>(stats.latency.percentile(0.999)) / 1e3);
+	json.field("max", static_cast<double>(stats.latency.max()) / 1e3);
+	json.endObject();
+	json.beginObject("server_rss_kb");
+	json.field("start", rss_start_kb);
+	json.field("ready", rss_ready_kb);
+	json.field("peak", stats.rss_peak_kb);
+	json.field("end", rss_end_kb);
+	json.endObject();
+	json.endObject();
+
+	if (opts.has("json"))
+		benchWriteFile(opts.get("json", ""), json.str());
+	std::cout << json.str() << std::endl;
+	return stats.delivered < stats.expected ? 2 : 0;
+}
@@ -0,0 +1,247 @@
+/**
+ * @brief Microbenchmarks for the per-message hot primitives
+ * 
+ * Self-contained (no Google Benchmark dependency): each case is auto-calibrated to run
+ * for about --min-ms milliseconds and reports ns/op and heap allocations/op, counted by
+ * replacing the global operator new for this binary.
+ * 
+ * Usage: microbench [--filter <substring>] [--min-ms <ms>] [--json <file>]
+ */
+
+#include "BenchCommon.hpp"
+#include "network/Channel.hpp"
+#include "network/Client.hpp"
+#include "network/Server.hpp"
+#include "protocol/MessageBuilder.hpp"
+#include "protocol/Parser.hpp"
+#include "protocol/ReplyStream.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// = Allocation counting =
+
+static std::uint64_t g_alloc_count = 0;
+
+void* operator new(std::size_t size) {
+	++g_alloc_count;
+	void* p = std::malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Keeps results observable so the compiler cannot drop the measured work at -O2+
+volatile std::size_t g_sink = 0;
+
+struct MicroResult {
+	std::string		name;
+	std::uint64_t	ops;
+	double			ns_per_op;
+	double			allocs_per_op;
+};
+
+/*
+	Runs `batch` ops per round: prepare() is untimed (refills buffers, drains output),
+	op() is timed. Rounds double until the timed total passes min_ns.
+*/
+template <typename Prepare, typename Op>
+MicroResult measure(const std::string& name, std::size_t batch, std::uint64_t min_ns, Prepare prepare, Op op) {
+	MicroResult r;
+	r.name = name;
+	std::uint64_t timed_ns = 0;
+	std::uint64_t allocs = 0;
+	std::uint64_t ops = 0;
+	std::size_t rounds = 1;
+	prepare();
+	for (std::size_t i = 0; i < batch; ++i)		// warm-up round
+		op(i);
+	while (timed_ns < min_ns) {
+		for (std::size_t round = 0; round < rounds; ++round) {
+			prepare();
+			std::uint64_t a0 = g_alloc_count;
+			std::uint64_t t0 = benchNowNs();
+			for (std::size_t i = 0; i < batch; ++i)
+				op(i);
+			timed_ns += benchNowNs() - t0;
+			allocs += g_alloc_count - a0;
+			ops += batch;
+		}
+		rounds *= 2;
+	}
+	r.ops = ops;
+	r.ns_per_op = static_cast<double>(timed_ns) / static_cast<double>(ops);
+	r.allocs_per_op = static_cast<double>(allocs) / static_cast<double>(ops);
+	return r;
+}
+
+void nothing() {}
+
+// Drop everything queued on a client, keeping the buffer's capacity (as send() does in the server)
+void drainClient(Client& client) {
+	client.consumeOutBuf(client.getOutBuf().size());
+	std::uint64_t stamp;
+	while (client.popSentMark(stamp))
+		;
+}
+
+}
+
+int main(int ac, char* av[]) {
+	BenchOptions opts(ac, av, 1);
+	std::string filter = opts.get("filter", "");
+	std::uint64_t min_ns = static_cast<std::uint64_t>(opts.getLong("min-ms", 200)) * 1000000ull;
+	std::vector<MicroResult> results;
+
+	// = Parser::parse =
+	const std::string privmsg = ":alice!alice@localhost PRIVMSG #general :" + std::string(380, 'p') + "\r\n";
+	const std::string mode = "MODE #general +oolkit alice bob 25 secret carol dave eve\r\n";
+	const std::string prefixed = ":irc.example.net 353 alice = #general :alice bob carol dave eve\r\n";
+	const std::string ping = "PING :irc.example.net\r\n";
+	struct { const char* name; const std::string* line; } parse_cases[] = {
+		{ "Parser::parse/privmsg_long_trailing", &privmsg },
+		{ "Parser::parse/mode_many_params", &mode },
+		{ "Parser::parse/prefixed_numeric", &prefixed },
+		{ "Parser::parse/ping", &ping },
+	};
+	for (std::size_t c = 0; c < sizeof(parse_cases) / sizeof(parse_cases[0]); ++c) {
+		if (std::string(parse_cases[c].name).find(filter) == std::string::npos)
+			continue;
+		const std::string& line = *parse_cases[c].line;
+		results.push_back(measure(parse_cases[c].name, 256, min_ns, nothing, [&](std::size_t) {
+			Message msg = Parser::parse(line);
+			g_sink = g_sink + msg.params.size() + msg.trailing.size();
+		}));
+	}
+
+	// = Message tags: lazy lookup of one escaped value (correctness: make tag-check) =
+	std::string tag_section;
+	MessageBuilder::appendTag(tag_section, "msgid", "42");
+	MessageBuilder::appendTag(tag_section, "backslash", "c:\\dir\\ a;b");
+	const std::string tagged = tag_section + " :alice!alice@localhost PRIVMSG #general :hi\r\n";
+	Message tagged_msg = Parser::parse(tagged);
+	if (std::string("Message::getTag/escaped").find(filter) != std::string::npos)
+		results.push_back(measure("Message::getTag/escaped", 256, min_ns, nothing, [&](std::size_t) {
+			std::string value;
+			tagged_msg.getTag("backslash", value);
+			g_sink = g_sink + value.size();
+		}));
+
+	// = MessageBuilder =
+	const std::string server = "ircserv";
+	const std::string prefix = "alice!alice@localhost";
+	const std::string text(200, 'm');
+	std::vector<std::string> params(1, "#general");
+	if (std::string("MessageBuilder::buildCommandMessage/privmsg").find(filter) != std::string::npos)
+		results.push_back(measure("MessageBuilder::buildCommandMessage/privmsg", 256, min_ns, nothing, [&](std::size_t) {
+			g_sink = g_sink + MessageBuilder::buildCommandMessage(prefix, "PRIVMSG", params, text).size();
+		}));
+	if (std::string("MessageBuilder::buildNumericReply/353").find(filter) != std::string::npos)
+		results.push_back(measure("MessageBuilder::buildNumericReply/353", 256, min_ns, nothing, [&](std::size_t) {
+			g_sink = g_sink + MessageBuilder::buildNumericReply(server, 353, "alice", "= #general :alice bob carol").size();
+		}));
+
+	// = Client::extractNextCmd on a pipelined buffer =
+	const std::size_t PIPELINE = 64;
+	std::string pipelined;
+	for (std::size_t i = 0; i < PIPELINE; ++i)
+		pipelined += "PRIVMSG #general :pipelined message number " + std::to_string(i) + "\r\n";
+	if (std::string("Client::extractNextCmd/pipelined64").find(filter) != std::string::npos) {
+		Client client(-1);
+		results.push_back(measure("Client::extractNextCmd/pipelined64", PIPELINE, min_ns,
+			[&]() { client.appendToInBuf(pipelined); },
+			[&](std::size_t) { g_sink = g_sink + client.extractNextCmd().size(); }));
+	}
+
+	// = Channel::broadcast at various member counts (per broadcast, not per copy) =
+	const std::string relay = ":alice!alice@localhost PRIVMSG #general :" + std::string(100, 'b') + "\r\n";
+	const std::size_t sizes[] = { 2, 10, 100, 1000 };
+	for (std::size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		std::string name = "Channel::broadcast/members=" + std::to_string(sizes[s]);
+		if (name.find(filter) == std::string::npos)
+			continue;
+		std::vector<Client*> members;
+		Channel channel;
+		for (std::size_t i = 0; i < sizes[s]; ++i) {
+			members.push_back(new Client(static_cast<int>(1000 + i)));
+			channel.addMember(members.back());
+		}
+		// drain output so every round starts from empty buffers (allocated capacity is kept, as in the server)
+		std::size_t batch = sizes[s] >= 1000 ? 4 : 32;
+		results.push_back(measure(name, batch, min_ns,
+			[&]() {
+				for (std::size_t i = 0; i < members.size(); ++i)
+					drainClient(*members[i]);
+			},
+			[&](std::size_t) { channel.broadcast(relay, 1000); }));
+		for (std::size_t i = 0; i < members.size(); ++i)
+			delete members[i];
+	}
+
+	// = NAMES: full reply from the cached blocks, and cache upkeep for one join + part =
+	const std::size_t names_sizes[] = { 100, 1000, 10000 };
+	Server names_server("micro");
+	for (std::size_t s = 0; s < sizeof(names_sizes) / sizeof(names_sizes[0]); ++s) {
+		std::string reply_name = "NamesStream::fill/members=" + std::to_string(names_sizes[s]);
+		std::string upkeep_name = "Channel::names_upkeep/members=" + std::to_string(names_sizes[s]);
+		if (reply_name.find(filter) == std::string::npos && upkeep_name.find(filter) == std::string::npos)
+			continue;
+		std::string channel_name = "#names" + std::to_string(names_sizes[s]);
+		Channel* channel = names_server.createChannel(channel_name);
+		std::vector<Client*> members;
+		for (std::size_t i = 0; i < names_sizes[s]; ++i) {
+			members.push_back(new Client(static_cast<int>(1000 + i)));
+			members.back()->setNickname("user" + std::to_string(i));
+			channel->addMember(members.back());
+			if (i % 10 == 0)
+				channel->addOperator(members.back()->getFD());
+		}
+		Client requester(-1);
+		requester.setNickname("alice");
+		if (reply_name.find(filter) != std::string::npos)
+			results.push_back(measure(reply_name, 4, min_ns, [&]() { drainClient(requester); }, [&](std::size_t) {
+				NamesStream names(names_server, server, channel_name, "");
+				g_sink = g_sink + names.fill(requester, static_cast<std::size_t>(-1));
+			}));
+		Client joiner(999);
+		joiner.setNickname("joiner");
+		if (upkeep_name.find(filter) != std::string::npos)
+			results.push_back(measure(upkeep_name, 64, min_ns, nothing, [&](std::size_t) {
+				channel->addMember(&joiner);
+				channel->removeMember(joiner.getFD());
+			}));
+		names_server.removeChannel(channel_name);
+		for (std::size_t i = 0; i < members.size(); ++i)
+			delete members[i];
+	}
+
+	// = Report =
+	JsonWriter json;
+	json.beginObject();
+	json.field("mode", "micro");
+	json.beginArray("results");
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		std::printf("%-45s %12.1f ns/op %8.2f allocs/op %12llu ops\n", results[i].name.c_str(),
+			results[i].ns_per_op, results[i].allocs_per_op, static_cast<unsigned long long>(results[i].ops));
+		json.beginObject();
+		json.field("name", results[i].name);
+		json.field("ns_per_op", results[i].ns_per_op);
+		json.field("allocs_per_op", results[i].allocs_per_op);
+		json.field("ops", results[i].ops);
+		json.endObject();
+	}
+	json.endArray();
+	json.endObject();
+	if (opts.has("json"))
+		benchWriteFile(opts.get("json", ""), json.str());
+	return 0;
+}
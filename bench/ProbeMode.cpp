@@ -0,0 +1,274 @@
+#include "BenchModes.hpp"
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <unistd.h>
+
+/**
+ * @brief "probe" mode: black-box SLO probe for a running server
+ * 
+ * Two probe clients join --channel; every --interval-ms the sender relays
+ * "PROBE <seq> <ns>" through the channel to the receiver and sends PING :P<seq>.<ns>
+ * to the server. Delivery latency and PING round trips go into a rolling --window-s
+ * window; every --report-s one JSON line with p50/p99/max and error counters is
+ * printed (and appended to --json). Messages unanswered after --timeout-ms count as
+ * lost; broken connections are counted and re-established with backoff.
+ * 
+ * Runs until SIGINT/SIGTERM or for --duration-s seconds (0 = forever). The two
+ * nicks are --nick followed by 0 and 1 (default probe<pid % 1000>).
+ */
+
+namespace {
+
+volatile std::sig_atomic_t g_probe_stop = 0;
+
+void probeStop(int) { g_probe_stop = 1; }
+
+struct Sample {
+	std::uint64_t	at_ns;
+	std::uint64_t	latency_ns;
+};
+
+// Samples from the last window_ns, oldest first
+class RollingWindow {
+	private:
+			std::deque<Sample>	m_samples;
+			std::uint64_t		m_window_ns;
+
+	public:
+			explicit RollingWindow(std::uint64_t window_ns) : m_samples(), m_window_ns(window_ns) {}
+
+			void	add(std::uint64_t now, std::uint64_t latency_ns) {
+				m_samples.push_back(Sample{now, latency_ns});
+			}
+
+			void	prune(std::uint64_t now) {
+				while (!m_samples.empty() && now - m_samples.front().at_ns > m_window_ns)
+					m_samples.pop_front();
+			}
+
+			void	write(JsonWriter& json, const std::string& key) const {
+				LatencySamples s;
+				for (std::size_t i = 0; i < m_samples.size(); ++i)
+					s.add(m_samples[i].latency_ns);
+				json.beginObject(key);
+				json.field("samples", static_cast<std::uint64_t>(s.count()));
+				json.field("p50", static_cast<double>(s.percentile(0.50)) / 1e3);
+				json.field("p99", static_cast<double>(s.percentile(0.99)) / 1e3);
+				json.field("max", static_cast<double>(s.max()) / 1e3);
+				json.endObject();
+			}
+};
+
+struct ProbeErrors {
+	std::uint64_t	connect_failures;
+	std::uint64_t	disconnects;
+	std::uint64_t	lost_messages;
+	std::uint64_t	lost_pongs;
+};
+
+class Probe {
+	private:
+			const BenchTarget&	m_target;
+			std::string			m_channel;
+			std::string			m_nick;
+			std::vector<BenchConn>	m_conns;		// [0] sender, [1] receiver
+			bool				m_up;
+			std::map<std::uint64_t, std::uint64_t>	m_pending_msg;		// seq -> send ns
+			std::map<std::uint64_t, std::uint64_t>	m_pending_ping;
+
+	public:
+			RollingWindow		delivery;
+			RollingWindow		ping;
+			ProbeErrors			errors;
+			std::uint64_t		sent;
+
+			Probe(const BenchTarget& target, const std::string& channel, const std::string& nick, std::uint64_t window_ns)
+				: m_target(target), m_channel(channel), m_nick(nick), m_conns(), m_up(false),
+				  m_pending_msg(), m_pending_ping(), delivery(window_ns), ping(window_ns),
+				  errors(), sent(0) {
+				errors.connect_failures = 0;
+				errors.disconnects = 0;
+				errors.lost_messages = 0;
+				errors.lost_pongs = 0;
+			}
+
+			~Probe() { drop(); }
+
+			bool	isUp() const { return m_up; }
+
+			bool	connect() {
+				if (!benchConnectAll(m_target, m_nick, 2, m_conns, 5000)) {
+					++errors.connect_failures;
+					drop();
+					return false;
+				}
+				for (std::size_t i = 0; i < m_conns.size(); ++i)
+					benchQueue(m_conns[i], "JOIN " + m_channel);
+				if (!benchWaitNumeric(m_conns, "366", std::vector<int>(2, 1), 10000)) {
+					++errors.connect_failures;
+					drop();
+					return false;
+				}
+				m_up = true;
+				return true;
+			}
+
+			void	drop() {
+				for (std::size_t i = 0; i < m_conns.size(); ++i) {
+					if (!m_conns[i].closed) {
+						benchQueue(m_conns[i], "QUIT :probe");
+						benchFlush(m_conns[i]);
+					}
+					benchClose(m_conns[i]);
+				}
+				m_conns.clear();
+				m_up = false;
+				m_pending_msg.clear();
+				m_pending_ping.clear();
+			}
+
+			void	send() {
+				std::uint64_t now = benchNowNs();
+				std::string stamp = std::to_string(sent) + " " + std::to_string(now);
+				benchQueue(m_conns[0], "PRIVMSG " + m_channel + " :PROBE " + stamp);
+				benchQueue(m_conns[0], "PING :P" + std::to_string(sent) + "." + std::to_string(now));
+				m_pending_msg[sent] = now;
+				m_pending_ping[sent] = now;
+				++sent;
+			}
+
+			void	poll(int timeout_ms, std::uint64_t timeout_ns) {
+				benchPoll(m_conns, timeout_ms);
+				std::uint64_t now = benchNowNs();
+				std::string line;
+				for (std::size_t i = 0; i < m_conns.size(); ++i) {
+					while (benchNextLine(m_conns[i], line)) {
+						std::size_t pos;
+						if (i == 1 && (pos = line.find(" :PROBE ")) != std::string::npos)
+							complete(m_pending_msg, std::strtoull(line.c_str() + pos + 8, NULL, 10), now, delivery);
+						else if (i == 0 && line.find(" PONG ") != std::string::npos && (pos = line.find(" :P")) != std::string::npos)
+							complete(m_pending_ping, std::strtoull(line.c_str() + pos + 3, NULL, 10), now, ping);
+						else if (line.compare(0, 5, "PING ") == 0)
+							benchQueue(m_conns[i], "PONG " + line.substr(5));
+					}
+					if (m_conns[i].closed && m_up) {
+						++errors.disconnects;
+						errors.lost_messages += m_pending_msg.size();		// in flight when the connection broke
+						errors.lost_pongs += m_pending_ping.size();
+						drop();
+						return;
+					}
+				}
+				errors.lost_messages += expire(m_pending_msg, now, timeout_ns);
+				errors.lost_pongs += expire(m_pending_ping, now, timeout_ns);
+			}
+
+	private:
+			static void	complete(std::map<std::uint64_t, std::uint64_t>& pending, std::uint64_t seq,
+				std::uint64_t now, RollingWindow& window) {
+				std::map<std::uint64_t, std::uint64_t>::iterator it = pending.find(seq);
+				if (it == pending.end())
+					return;
+				window.add(now, now - it->second);
+				pending.erase(it);
+			}
+
+			static std::uint64_t	expire(std::map<std::uint64_t, std::uint64_t>& pending,
+				std::uint64_t now, std::uint64_t timeout_ns) {
+				std::uint64_t lost = 0;
+				while (!pending.empty() && now - pending.begin()->second > timeout_ns) {
+					pending.erase(pending.begin());
+					++lost;
+				}
+				return lost;
+			}
+};
+
+}
+
+int runProbe(const BenchOptions& opts) {
+	std::uint64_t interval_ns = static_cast<std::uint64_t>(opts.getLong("interval-ms", 1000)) * 1000000ull;
+	std::uint64_t window_ns = static_cast<std::uint64_t>(opts.getLong("window-s", 60)) * 1000000000ull;
+	std::uint64_t report_ns = static_cast<std::uint64_t>(opts.getLong("report-s", 10)) * 1000000000ull;
+	std::uint64_t timeout_ns = static_cast<std::uint64_t>(opts.getLong("timeout-ms", 5000)) * 1000000ull;
+	double duration_s = opts.getDouble("duration-s", 0.0);
+	std::string channel = opts.get("channel", "#probe");
+	std::string nick = opts.get("nick", "probe" + std::to_string(getpid() % 1000));	// + 0/1, within 9 chars
+	std::string json_path = opts.get("json", "");
+
+	BenchTarget target;
+	if (!benchOpenTarget(opts, target)) {
+		std::cerr << "probe: could not start server\n";
+		return 1;
+	}
+	signal(SIGINT, probeStop);
+	signal(SIGTERM, probeStop);
+
+	Probe probe(target, channel, nick, window_ns);
+	std::uint64_t start = benchNowNs();
+	std::uint64_t next_send = start;
+	std::uint64_t next_report = start + report_ns;
+	std::uint64_t backoff_ns = 500000000ull;
+	std::uint64_t retry_at = start;
+	while (!g_probe_stop) {
+		std::uint64_t now = benchNowNs();
+		if (duration_s > 0 && static_cast<double>(now - start) / 1e9 >= duration_s)
+			break;
+		if (!probe.isUp()) {
+			if (now >= retry_at && !probe.connect()) {
+				retry_at = benchNowNs() + backoff_ns;
+				backoff_ns = std::min<std::uint64_t>(backoff_ns * 2, 30000000000ull);
+			} else if (probe.isUp())
+				backoff_ns = 500000000ull;
+		}
+		if (probe.isUp()) {
+			if (now >= next_send) {
+				probe.send();
+				next_send += interval_ns;
+				if (next_send < now)
+					next_send = now + interval_ns;
+			}
+			probe.poll(10, timeout_ns);
+		} else
+			usleep(10000);
+
+		now = benchNowNs();
+		bool last = g_probe_stop || (duration_s > 0 && static_cast<double>(now - start) / 1e9 >= duration_s);
+		if (now >= next_report || last) {
+			next_report = now + report_ns;
+			probe.delivery.prune(now);
+			probe.ping.prune(now);
+			JsonWriter json;
+			json.beginObject();
+			json.field("mode", "probe");
+			json.field("uptime_s", static_cast<double>(now - start) / 1e9);
+			json.field("connected", probe.isUp());
+			json.field("sent", probe.sent);
+			probe.delivery.write(json, "delivery_us");
+			probe.ping.write(json, "ping_rtt_us");
+			json.beginObject("errors");
+			json.field("connect_failures", probe.errors.connect_failures);
+			json.field("disconnects", probe.errors.disconnects);
+			json.field("lost_messages", probe.errors.lost_messages);
+			json.field("lost_pongs", probe.errors.lost_pongs);
+			json.endObject();
+			json.endObject();
+			std::cout << json.str() << std::endl;
+			if (!json_path.empty()) {
+				std::FILE* f = std::fopen(json_path.c_str(), "a");
+				if (f) {
+					std::fprintf(f, "%s\n", json.str().c_str());
+					std::fclose(f);
+				}
+			}
+		}
+	}
+	probe.drop();
+	benchCloseTarget(target);
+	return 0;
+}
@@ -0,0 +1,206 @@
+#include "BenchModes.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sys/socket.h>
+
+/**
+ * @brief "replay" mode: re-drive an IRCSERV_CAPTURE file against a fresh server
+ * 
+ * Connections are opened, fed and closed on the captured schedule divided by
+ * --speed (1 = real time, 10 = ten times faster, 0 = as fast as possible).
+ * A captured CLOSE becomes shutdown(SHUT_WR): the server sees EOF (or already
+ * closed after QUIT), flushes and disconnects, and the bytes read until then
+ * are compared with the bytes the original server sent on that connection.
+ * 
+ * At max speed lines of different connections are no longer spaced, so replies
+ * that depend on cross-connection ordering (a JOIN racing a PRIVMSG) may differ.
+ * The captured PASS lines are replayed as is: start the server with the same password.
+ */
+
+namespace {
+
+struct CaptureRecord {
+	int				type;
+	std::uint64_t	at_us;				// absolute offset from the start of the capture
+	std::uint64_t	conn;
+	std::string		line;
+	std::uint64_t	bytes_out;
+};
+
+bool getVarint(const std::string& data, std::size_t& pos, std::uint64_t& v) {
+	v = 0;
+	for (unsigned shift = 0; pos < data.size() && shift < 64; shift += 7) {
+		unsigned char byte = static_cast<unsigned char>(data[pos++]);
+		v |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool loadCapture(const std::string& path, std::vector<CaptureRecord>& records) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (data.compare(0, 8, "IRCCAP1\n") != 0)
+		return false;
+	std::size_t pos = 8;
+	std::uint64_t at = 0;
+	while (pos < data.size()) {
+		CaptureRecord rec;
+		std::uint64_t delta;
+		rec.type = static_cast<unsigned char>(data[pos++]);
+		rec.bytes_out = 0;
+		if (!getVarint(data, pos, delta) || !getVarint(data, pos, rec.conn))
+			return false;
+		at += delta;
+		rec.at_us = at;
+		if (rec.type == 2) {
+			std::uint64_t len;
+			if (!getVarint(data, pos, len) || pos + len > data.size())
+				return false;
+			rec.line.assign(data, pos, static_cast<std::size_t>(len));
+			pos += static_cast<std::size_t>(len);
+		} else if (rec.type == 3) {
+			if (!getVarint(data, pos, rec.bytes_out))
+				return false;
+		} else if (rec.type != 1)
+			return false;
+		records.push_back(rec);
+	}
+	return true;
+}
+
+struct ReplayConn {
+	std::size_t		index;				// into the BenchConn vector
+	std::uint64_t	bytes_in;
+	std::uint64_t	expected_out;		// from the CLOSE record, if any
+	bool			closing;			// CLOSE reached: shutdown once outbuf is flushed
+	bool			shut;
+	bool			has_close;
+};
+
+}
+
+int runReplay(const BenchOptions& opts) {
+	std::vector<CaptureRecord> records;
+	if (!opts.has("capture") || !loadCapture(opts.get("capture", ""), records)) {
+		std::cerr << "replay: need --capture <file> in IRCCAP1 format\n";
+		return 1;
+	}
+	double speed = opts.getDouble("speed", 1.0);
+	long drain_ms = opts.getLong("drain-ms", 3000);
+	BenchTarget target;
+	if (!benchOpenTarget(opts, target)) {
+		std::cerr << "replay: could not start server\n";
+		return 1;
+	}
+
+	std::vector<BenchConn> conns;
+	std::map<std::uint64_t, ReplayConn> by_id;
+	std::uint64_t lines = 0;
+	std::uint64_t failed_connects = 0;
+	std::uint64_t start = benchNowNs();
+	std::size_t next = 0;
+	std::uint64_t drain_deadline = 0;
+	while (true) {
+		std::uint64_t elapsed_us = (benchNowNs() - start) / 1000;
+		for (; next < records.size(); ++next) {
+			const CaptureRecord& rec = records[next];
+			if (speed > 0 && static_cast<double>(rec.at_us) / speed > static_cast<double>(elapsed_us))
+				break;
+			if (rec.type == 1) {
+				BenchConn conn;
+				conn.fd = benchConnect(target.host, target.port);
+				if (conn.fd < 0) {
+					++failed_connects;
+					continue;
+				}
+				ReplayConn rc = { conns.size(), 0, 0, false, false, false };
+				conns.push_back(conn);
+				by_id[rec.conn] = rc;
+				continue;
+			}
+			std::map<std::uint64_t, ReplayConn>::iterator it = by_id.find(rec.conn);
+			if (it == by_id.end())
+				continue;
+			if (rec.type == 2) {
+				benchQueue(conns[it->second.index], rec.line);
+				++lines;
+			} else {
+				it->second.closing = true;
+				it->second.has_close = true;
+				it->second.expected_out = rec.bytes_out;
+			}
+		}
+		benchPoll(conns, 1);
+		bool open = false;
+		for (std::map<std::uint64_t, ReplayConn>::iterator it = by_id.begin(); it != by_id.end(); ++it) {
+			BenchConn& conn = conns[it->second.index];
+			it->second.bytes_in += conn.inbuf.size();
+			conn.inbuf.clear();
+			if (it->second.closing && !it->second.shut && conn.outbuf.empty() && !conn.closed) {
+				shutdown(conn.fd, SHUT_WR);
+				it->second.shut = true;
+			}
+			open = open || (it->second.closing && !conn.closed);
+		}
+		if (next < records.size())
+			continue;
+		// all records sent: wait for the server to finish the captured closes
+		if (drain_deadline == 0)
+			drain_deadline = benchNowNs() + static_cast<std::uint64_t>(drain_ms) * 1000000ull;
+		if (!open || benchNowNs() > drain_deadline)
+			break;
+	}
+	double replay_s = static_cast<double>(benchNowNs() - start) / 1e9;
+	long rss_kb = benchRssKb(target.pid);
+
+	// = Compare outbound bytes on connections with a captured CLOSE =
+	std::uint64_t compared = 0;
+	std::uint64_t matched = 0;
+	std::uint64_t expected_total = 0;
+	std::uint64_t got_total = 0;
+	for (std::map<std::uint64_t, ReplayConn>::iterator it = by_id.begin(); it != by_id.end(); ++it) {
+		if (!it->second.has_close)
+			continue;
+		++compared;
+		expected_total += it->second.expected_out;
+		got_total += it->second.bytes_in;
+		if (it->second.expected_out == it->second.bytes_in)
+			++matched;
+		else if (opts.has("verbose"))
+			std::cerr << "replay: conn " << it->first << " expected " << it->second.expected_out
+				<< " bytes, got " << it->second.bytes_in << "\n";
+	}
+	for (std::size_t i = 0; i < conns.size(); ++i)
+		benchClose(conns[i]);
+	benchCloseTarget(target);
+
+	JsonWriter json;
+	json.beginObject();
+	json.field("mode", "replay");
+	json.field("capture", opts.get("capture", ""));
+	json.field("speed", speed);
+	json.field("records", static_cast<std::uint64_t>(records.size()));
+	json.field("connections", static_cast<std::uint64_t>(by_id.size()));
+	json.field("failed_connects", failed_connects);
+	json.field("lines", lines);
+	json.field("captured_s", records.empty() ? 0.0 : static_cast<double>(records.back().at_us) / 1e6);
+	json.field("replay_s", replay_s);
+	json.field("lines_per_s", replay_s > 0 ? static_cast<double>(lines) / replay_s : 0.0);
+	json.beginObject("outbound_bytes");
+	json.field("connections_compared", compared);
+	json.field("connections_matched", matched);
+	json.field("expected", expected_total);
+	json.field("replayed", got_total);
+	json.endObject();
+	json.field("server_rss_kb", rss_kb);
+	json.endObject();
+	if (opts.has("json"))
+		benchWriteFile(opts.get("json", ""), json.str());
+	std::cout << json.str() << std::endl;
+	return matched == compared ? 0 : 2;
+}
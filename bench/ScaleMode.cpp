@@ -0,0 +1,212 @@
+#include "BenchModes.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+/**
+ * @brief "scale" mode: server memory and registration rate versus connection and channel counts
+ * 
+ * 1. grow to each --clients-steps count (default 1000,10000,100000) of registered idle
+ *    connections, in --batch sized waves; per step: RSS, bytes per idle client, and the
+ *    connect+register rate of the wave
+ * 2. with all clients connected, grow to each --channel-steps count (default 1000,100000)
+ *    of channels with one member each (bytes per channel), then give every channel a
+ *    second member (bytes per additional membership)
+ * 
+ * RSS comes from /proc/<pid>/status of a --spawn'ed (or --server-pid) server and is taken
+ * after --settle-ms. Source addresses rotate over 127.0.0.2.. every --per-ip connections so
+ * the ephemeral port range does not cap the count. Steps above the fd limit are skipped
+ * and reported as such.
+ */
+
+namespace {
+
+struct ScaleStep {
+	std::string		kind;				// "clients", "channels", "memberships"
+	std::size_t		clients;
+	std::size_t		channels;
+	std::size_t		memberships;
+	long			rss_kb;
+	double			bytes_per_unit;		// RSS growth of this step / units added
+	double			rate_per_s;			// registrations or joins per second
+	bool			skipped;
+};
+
+std::vector<std::size_t> parseSteps(const std::string& list) {
+	std::vector<std::size_t> out;
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ','))
+		if (!item.empty())
+			out.push_back(static_cast<std::size_t>(std::strtoul(item.c_str(), NULL, 10)));
+	return out;
+}
+
+void settle(std::vector<BenchConn>& conns, long ms) {
+	std::uint64_t until = benchNowNs() + static_cast<std::uint64_t>(ms) * 1000000ull;
+	while (benchNowNs() < until) {
+		benchPoll(conns, 10);
+		for (std::size_t i = 0; i < conns.size(); ++i)
+			conns[i].inbuf.clear();
+	}
+}
+
+// Queue JOINs from conns[first_conn + k % n] for channels [from, to), wait for every 366
+bool joinWave(std::vector<BenchConn>& conns, std::size_t first_conn, std::size_t from, std::size_t to) {
+	std::vector<int> want(conns.size(), 0);
+	for (std::size_t c = from; c < to; ++c) {
+		std::size_t who = (first_conn + c) % conns.size();
+		benchQueue(conns[who], "JOIN #s" + std::to_string(c));
+		++want[who];
+	}
+	return benchWaitNumeric(conns, "366", want, 120000);
+}
+
+}
+
+int runScale(const BenchOptions& opts) {
+	std::vector<std::size_t> client_steps = parseSteps(opts.get("clients-steps", "1000,10000,100000"));
+	std::vector<std::size_t> channel_steps = parseSteps(opts.get("channel-steps", "1000,100000"));
+	std::size_t batch = static_cast<std::size_t>(opts.getLong("batch", 500));
+	std::size_t per_ip = static_cast<std::size_t>(opts.getLong("per-ip", 25000));
+	long settle_ms = opts.getLong("settle-ms", 300);
+
+	long fd_limit = benchRaiseFdLimit();
+	BenchTarget target;
+	if (!benchOpenTarget(opts, target) || target.pid <= 0) {
+		std::cerr << "scale: needs --spawn <binary> or --server-pid for RSS\n";
+		benchCloseTarget(target);
+		return 1;
+	}
+	// both ends live on this host: the bench and the server each need one fd per connection
+	std::size_t max_clients = fd_limit > 64 ? static_cast<std::size_t>(fd_limit - 64) : 0;
+	std::vector<BenchConn> conns;
+	std::vector<ScaleStep> steps;
+	long rss_base = benchRssKb(target.pid);
+	long rss_prev = rss_base;
+	std::string line;
+
+	// = Connections =
+	for (std::size_t s = 0; s < client_steps.size(); ++s) {
+		ScaleStep step = { "clients", client_steps[s], 0, 0, -1, 0.0, 0.0, false };
+		if (client_steps[s] > max_clients) {
+			step.skipped = true;
+			steps.push_back(step);
+			std::fprintf(stderr, "clients %8zu  skipped (fd limit %ld)\n", client_steps[s], fd_limit);
+			continue;
+		}
+		std::size_t before = conns.size();
+		std::uint64_t t0 = benchNowNs();
+		bool ok = true;
+		while (ok && conns.size() < client_steps[s]) {
+			std::size_t wave = std::min(batch, client_steps[s] - conns.size());
+			std::vector<BenchConn> fresh(wave);
+			for (std::size_t i = 0; i < wave && ok; ++i) {
+				std::size_t id = conns.size() + i;
+				std::string source = "127.0.0." + std::to_string(2 + id / per_ip);
+				fresh[i].fd = benchConnect(target.host, target.port, source);
+				fresh[i].nick = "s" + std::to_string(id);
+				ok = fresh[i].fd >= 0;
+				if (ok)
+					benchRegister(fresh[i], target.password);
+			}
+			ok = ok && benchWaitNumeric(fresh, "001", std::vector<int>(wave, 1), 60000);
+			for (std::size_t i = 0; i < wave; ++i) {
+				fresh[i].inbuf.clear();
+				conns.push_back(fresh[i]);
+			}
+		}
+		if (!ok) {
+			std::cerr << "scale: connect/register failed at " << conns.size() << " clients\n";
+			break;
+		}
+		double elapsed = static_cast<double>(benchNowNs() - t0) / 1e9;
+		settle(conns, settle_ms);
+		step.rss_kb = benchRssKb(target.pid);
+		step.bytes_per_unit = static_cast<double>(step.rss_kb - rss_base) * 1024.0 / static_cast<double>(conns.size());
+		step.rate_per_s = elapsed > 0 ? static_cast<double>(conns.size() - before) / elapsed : 0.0;
+		rss_prev = step.rss_kb;
+		steps.push_back(step);
+		std::fprintf(stderr, "clients %8zu  rss %8ld kB  %8.0f B/client  %8.0f reg/s\n",
+			conns.size(), step.rss_kb, step.bytes_per_unit, step.rate_per_s);
+	}
+
+	// = Channels, then a second member per channel =
+	std::size_t channels = 0;
+	if (conns.size() >= 2) {
+		for (std::size_t s = 0; s < channel_steps.size(); ++s) {
+			std::size_t goal = channel_steps[s];
+			std::uint64_t t0 = benchNowNs();
+			long rss_before = rss_prev;
+			for (std::size_t from = channels; from < goal; from += batch) {
+				if (!joinWave(conns, 0, from, std::min(goal, from + batch))) {
+					std::cerr << "scale: joins failed at " << from << " channels\n";
+					goal = from;
+					break;
+				}
+			}
+			double elapsed = static_cast<double>(benchNowNs() - t0) / 1e9;
+			settle(conns, settle_ms);
+			ScaleStep step = { "channels", conns.size(), goal, goal, benchRssKb(target.pid), 0.0, 0.0, false };
+			if (goal > channels) {
+				step.bytes_per_unit = static_cast<double>(step.rss_kb - rss_before) * 1024.0 / static_cast<double>(goal - channels);
+				step.rate_per_s = elapsed > 0 ? static_cast<double>(goal - channels) / elapsed : 0.0;
+			}
+			channels = goal;
+			rss_prev = step.rss_kb;
+			steps.push_back(step);
+			std::fprintf(stderr, "channels %7zu  rss %8ld kB  %8.0f B/channel  %8.0f joins/s\n",
+				channels, step.rss_kb, step.bytes_per_unit, step.rate_per_s);
+		}
+		if (channels > 0) {
+			// the second member of channel c is the next client round the ring
+			std::uint64_t t0 = benchNowNs();
+			long rss_before = rss_prev;
+			for (std::size_t from = 0; from < channels; from += batch)
+				if (!joinWave(conns, 1, from, std::min(channels, from + batch)))
+					break;
+			double elapsed = static_cast<double>(benchNowNs() - t0) / 1e9;
+			settle(conns, settle_ms);
+			ScaleStep step = { "memberships", conns.size(), channels, channels * 2, benchRssKb(target.pid), 0.0, 0.0, false };
+			step.bytes_per_unit = static_cast<double>(step.rss_kb - rss_before) * 1024.0 / static_cast<double>(channels);
+			step.rate_per_s = elapsed > 0 ? static_cast<double>(channels) / elapsed : 0.0;
+			steps.push_back(step);
+			std::fprintf(stderr, "members %8zu  rss %8ld kB  %8.0f B/membership\n",
+				channels * 2, step.rss_kb, step.bytes_per_unit);
+		}
+	}
+	for (std::size_t i = 0; i < conns.size(); ++i)
+		benchClose(conns[i]);
+	benchCloseTarget(target);
+
+	JsonWriter json;
+	json.beginObject();
+	json.field("mode", "scale");
+	json.field("fd_limit", fd_limit);
+	json.field("rss_base_kb", rss_base);
+	json.beginArray("steps");
+	for (std::size_t i = 0; i < steps.size(); ++i) {
+		const char* unit = steps[i].kind == "clients" ? "bytes_per_client"
+			: steps[i].kind == "channels" ? "bytes_per_channel" : "bytes_per_membership";
+		json.beginObject();
+		json.field("kind", steps[i].kind);
+		json.field("clients", static_cast<std::uint64_t>(steps[i].clients));
+		json.field("channels", static_cast<std::uint64_t>(steps[i].channels));
+		json.field("memberships", static_cast<std::uint64_t>(steps[i].memberships));
+		json.field("skipped", steps[i].skipped);
+		if (!steps[i].skipped) {
+			json.field("rss_kb", steps[i].rss_kb);
+			json.field(unit, steps[i].bytes_per_unit);
+			json.field(steps[i].kind == "clients" ? "registrations_per_s" : "joins_per_s", steps[i].rate_per_s);
+		}
+		json.endObject();
+	}
+	json.endArray();
+	json.endObject();
+	if (opts.has("json"))
+		benchWriteFile(opts.get("json", ""), json.str());
+	std::cout << json.str() << std::endl;
+	return 0;
+}
@@ -0,0 +1,80 @@
+#!/bin/sh
+# Build ircserv as -O0 (default), release and pgo, run the same workloads against
+# each and report the gain of every step. Run from the repository root (make bench-builds).
+#
+#   inproc  - CPU cost of the command pipeline (bench/inproc, best of REPEAT runs)
+#   load    - loopback delivery latency under fan-out (ircbench load)
+#
+# Binaries are kept in OUT_DIR (bench/builds); the tree is left with a default build.
+
+set -e
+
+OUT_DIR=${OUT_DIR:-bench/builds}
+REPEAT=${REPEAT:-3}
+PORT=${PORT:-6693}
+INPROC_ARGS=${INPROC_ARGS:-"--clients 1000 --channels 50 --rounds 200 --senders 50"}
+LOAD_ARGS=${LOAD_ARGS:-"--clients 200 --channels 20 --dist zipf --rate 4000 --duration 5 --query-every 25"}
+JSON=${JSON:-bench-builds.json}
+
+mkdir -p "$OUT_DIR"
+
+# Extract a numeric field from a one-line JSON report
+field() {
+	sed -n "s/.*\"$1\":\([-0-9.]*\).*/\1/p"
+}
+
+# ratio <old> <new>: gain of a step (1.25: the step made the pipeline 25% faster)
+ratio() {
+	awk -v a="$1" -v b="$2" 'BEGIN { printf "%.2f", (b > 0 ? a / b : 0) }'
+}
+
+# The load generator itself stays a default build so only the server changes
+make -s re > /dev/null
+make -s loadgen > /dev/null
+cp bench/ircbench "$OUT_DIR/ircbench"
+
+# build <variant> <make target> [make variables the inproc harness is linked with]
+build() {
+	echo "building $1"
+	make -s "$2" > /dev/null
+	cp ircserv "$OUT_DIR/ircserv-$1"
+	make -s $3 bench/inproc > /dev/null
+	cp bench/inproc "$OUT_DIR/inproc-$1"
+}
+
+build O0 re
+build release release RELEASE=1
+build pgo pgo PGO=use
+make -s re > /dev/null
+
+echo "{\"mode\":\"builds\",\"variants\":[" > "$JSON"
+printf '%-8s %12s %10s %10s %10s %10s %8s %8s\n' variant ns/msg reg_us join_us p50_us p99_us "vs prev" "vs O0"
+prev=
+base=
+sep=
+for variant in O0 release pgo; do
+	best=
+	i=0
+	while [ $i -lt "$REPEAT" ]; do
+		report=$("$OUT_DIR/inproc-$variant" $INPROC_ARGS)
+		ns=$(echo "$report" | field ns_per_inbound_msg)
+		if [ -z "$best" ] || awk -v a="$ns" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+			best=$ns
+			reg=$(echo "$report" | field register_us_per_client)
+			join=$(echo "$report" | field join_us_per_client)
+		fi
+		i=$((i + 1))
+	done
+	load=$("$OUT_DIR/ircbench" load $LOAD_ARGS --spawn "$OUT_DIR/ircserv-$variant" --port "$PORT" 2> /dev/null)
+	p50=$(echo "$load" | field p50)
+	p99=$(echo "$load" | field p99)
+	[ -n "$prev" ] || prev=$best
+	[ -n "$base" ] || base=$best
+	vs_prev=$(ratio "$prev" "$best")
+	vs_base=$(ratio "$base" "$best")
+	printf '%-8s %12.1f %10.2f %10.2f %10.1f %10.1f %7sx %7sx\n' "$variant" "$best" "$reg" "$join" "$p50" "$p99" "$vs_prev" "$vs_base"
+	echo "$sep{\"variant\":\"$variant\",\"ns_per_inbound_msg\":$best,\"register_us_per_client\":$reg,\"join_us_per_client\":$join,\"load_p50_us\":$p50,\"load_p99_us\":$p99,\"gain_vs_prev\":$vs_prev,\"gain_vs_O0\":$vs_base}" >> "$JSON"
+	sep=,
+	prev=$best
+done
+echo "]}" >> "$JSON"
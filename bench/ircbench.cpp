@@ -0,0 +1,43 @@
+#include "BenchModes.hpp"
+#include <cstring>
+#include <iostream>
+
+/**
+ * @brief ircbench: loopback benchmark driver for ircserv
+ * 
+ * Usage: ircbench <mode> [--key value ...]
+ */
+
+struct BenchMode {
+	const char*	name;
+	int			(*run)(const BenchOptions& opts);
+	const char*	help;
+};
+
+static const BenchMode g_modes[] = {
+	{ "load", runLoad, "N clients in M channels, PRIVMSG at a target rate; latency, msgs/s, RSS" },
+	{ "replay", runReplay, "re-drive an IRCSERV_CAPTURE file at 1x/Nx/max speed, compare outbound bytes" },
+	{ "attack", runAttack, "legit latency + server RSS under idle, slowloris, oversized, unknown, non-reading WHO attackers" },
+	{ "scale", runScale, "RSS and registration rate at 1k/10k/100k clients and 1k/100k channels" },
+	{ "probe", runProbe, "stay connected and report rolling p50/p99 delivery and PING latency plus errors" },
+};
+
+static void usage(const char* prog) {
+	std::cerr << "Usage: " << prog << " <mode> [--key value ...]\n\nModes:\n";
+	for (std::size_t i = 0; i < sizeof(g_modes) / sizeof(g_modes[0]); ++i)
+		std::cerr << "  " << g_modes[i].name << "\t" << g_modes[i].help << "\n";
+	std::cerr << "\nSee bench/README.md for the options of each mode.\n";
+}
+
+int main(int ac, char* av[]) {
+	if (ac < 2) {
+		usage(av[0]);
+		return 1;
+	}
+	for (std::size_t i = 0; i < sizeof(g_modes) / sizeof(g_modes[0]); ++i) {
+		if (std::strcmp(av[1], g_modes[i].name) == 0)
+			return g_modes[i].run(BenchOptions(ac, av, 2));
+	}
+	usage(av[0]);
+	return 1;
+}
@@ -4,9 +4,21 @@
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
+#include <cstdint>
 
 class Client;
 
+// One recorded channel message (PRIVMSG/NOTICE/TOPIC), kept exactly as it was broadcast
+struct HistoryEntry {
+    std::uint64_t   msgid;          // server-wide, increasing
+    std::uint64_t   time_ms;        // wall clock (ms since epoch), never decreasing within a channel
+    int             exclude_fd;     // member the broadcast skipped (the sender), -1 if none
+    std::string     line;           // "@msgid=..;time=.. " + serialized message including \r\n
+    std::size_t     tags_size;      // bytes of the tag section (line + tags_size = untagged message)
+    std::size_t     time_pos;       // offset of the "time=" tag (see Client::queueEntry)
+};
+
 class Channel 
 {
     private:
@@ -16,17 +28,38 @@ class Channel
             std::map<int, Client*>  m_members;          // All channel members (fd -> Client*)
             std::set<int>           m_operators;        // Channel operators (fd)
             std::set<int>           m_invited;          // Invited users (fd)
+
+            // NAMES cache: RPL_NAMREPLY bodies ("@op nick ...") patched on join/part/op/nick changes
+            std::vector<std::string>    m_names_blocks;     // pre-serialized, each at most NAMES_BLOCK_BYTES
+            std::vector<bool>           m_names_open;       // block is listed in m_names_free
+            std::vector<std::size_t>    m_names_free;       // blocks that had room when last checked
+            std::map<int, std::size_t>  m_names_block_of;   // fd -> block holding its entry
+
+            // History ring: slots are reused once full, so steady-state recording does not allocate
+            std::vector<HistoryEntry>   m_history;          // slab of at most m_history_max_lines slots
+            std::size_t                 m_history_max_lines;
+            std::size_t                 m_history_max_bytes;
+            std::size_t                 m_history_head;     // slot of the oldest entry
+            std::size_t                 m_history_count;    // live entries
+            std::size_t                 m_history_bytes;    // sum of live line sizes (capped at m_history_max_bytes)
+            std::uint64_t               m_history_first_seq;// channel-local sequence number of the oldest entry
+
+            // Broadcast log: members read the history ring through cursors (see Client::pullLogs)
+            bool                        m_broadcast_log;    // messages are appended to the ring only, not to every member
+            std::set<int>               m_log_waiters;      // members with nothing left to send: wake them on the next append
             
             // Channel modes
             bool    m_invite_only;                      // +i (invite only)
             bool    m_topic_protected;                  // +t (only ops can change topic)
             int     m_user_limit;                       // +l (user limit, 0 means no limit)
+            bool    m_auditorium;                       // +u (JOIN/PART/QUIT/NICK of non-ops only reach ops)
 
     public:
-            // OCF
+            // OCF (copy disabled: the server owns each channel through a unique_ptr,
+            // and members' broadcast log cursors point at this instance)
             Channel();
-            Channel(const Channel& src);
-            Channel& operator=(const Channel& rhs);
+            Channel(const Channel& src) = delete;
+            Channel& operator=(const Channel& rhs) = delete;
             ~Channel();
 
             // === Metadata ===
@@ -45,10 +78,12 @@ class Channel
             void                addOperator(int fd);
             void                removeOperator(int fd);
             bool                isOperator(int fd) const;
+            const std::set<int>& getOperators() const;
             // === Modes ===
             void                setUserLimit(int limit);
             void                setInviteOnly(bool enable);
             void                setTopicProtected(bool enable);
+            void                setAuditorium(bool enable);
             void                setKey(const std::string& key);
             void                removeKey();
             int                 getUserLimit() const;
@@ -56,14 +91,38 @@ class Channel
             bool                hasKey() const;
             bool                isInviteOnly() const;
             bool                isTopicProtected() const;
+            bool                isAuditorium() const;
 
             // === Invites ===
             void                addInvited(int fd);
             bool                isInvited(int fd) const;
             void                removeInvited(int fd);
 
+            // === NAMES cache ===
+            const std::vector<std::string>& getNamesBlocks() const;     // may contain empty blocks (skip them)
+            void                renameMember(int fd, const std::string& old_nick);
+
+            // === History ===
+            const HistoryEntry& recordHistory(std::uint64_t msgid, std::uint64_t time_ms, const std::string& line, int exclude_fd = -1);
+            std::size_t         getHistorySize() const;
+            const HistoryEntry& getHistoryAt(std::size_t index) const;  // 0 = oldest
+            std::uint64_t       getHistoryFirstSeq() const;             // sequence number of getHistoryAt(0)
+            std::uint64_t       getHistoryEndSeq() const;               // sequence number the next entry will get
+
+            // === Broadcast log ===
+            void                enableBroadcastLog();
+            bool                hasBroadcastLog() const;
+            void                addLogWaiter(int fd);
+            void                takeLogWaiters(std::set<int>& waiters);  // hands over (and clears) the waiting members
+
             // === Utils ===
             void                broadcast(const std::string& message, int exclude_fd = -1);
+            void                broadcastEntry(const HistoryEntry& entry, int exclude_fd = -1);   // each member gets its tag variant
+
+    private:
+            std::string         namesEntry(int fd, const std::string& nick) const;
+            void                namesInsert(int fd);
+            void                namesErase(int fd, const std::string& entry);
 };
 
 #endif
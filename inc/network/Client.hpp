@@ -3,13 +3,52 @@
 
 #include <string>
 #include <set>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <bitset>
+#include <cstdint>
+
+class ReplyStream;
+class Channel;
+struct HistoryEntry;
+
+// IRCv3 capabilities a client can enable with CAP REQ (bit positions in Client's capability set)
+enum Capability {
+	CAP_ECHO_MESSAGE,		// PRIVMSG/NOTICE are echoed back to their sender
+	CAP_MESSAGE_TAGS,		// any tag may be sent (msgid, time, ...)
+	CAP_SERVER_TIME,		// time tag on recorded messages
+	CAP_BATCH,				// multi-line replies (NAMES, WHO, CHATHISTORY) framed by BATCH
+	CAP_NO_IMPLICIT_NAMES,	// JOIN does not send the NAMES reply
+	CAP_COUNT
+};
+
+// Longest input a client may buffer: one full line of 8191 bytes of IRCv3 tags plus a 512-byte message
+static const std::size_t	MAX_INBUF = 8191 + 512;
 
 class Client
 {
 	private:
+			// Enqueue stamp for a block of output: bytes up to stream offset `end` were queued at `enqueued_us`
+			struct OutMark {
+				std::uint64_t	end;
+				std::uint64_t	enqueued_us;
+			};
+
 			int			m_fd;
 			std::string	m_inbuf;				// Partial commands
 			std::string	m_outbuf;				// Data to send
+			std::deque<OutMark>	m_out_marks;	// Enqueue timestamps of pending output blocks (oldest first)
+			std::uint64_t	m_out_appended;		// Total bytes ever queued to m_outbuf
+			std::uint64_t	m_out_sent;			// Total bytes ever taken by send()
+
+			// Read position in the broadcast log of a channel (Channel::enableBroadcastLog)
+			struct LogCursor {
+				Channel*		channel;
+				std::uint64_t	next_seq;		// sequence number of the next history entry to deliver
+			};
+			std::vector<LogCursor>	m_log_cursors;
+			std::uint64_t	m_log_dropped;		// log entries skipped because the ring evicted them before delivery
 			
 			// IRC protocol state
 			std::string m_nickname;
@@ -21,6 +60,13 @@ class Client
 			bool        m_should_disconnect;	// Should server disconnect this client?
 			std::string m_quit_reason;			// Reason for disconnection (for QUIT)
 			std::string m_user_modes;			// User modes (i, o, w, etc.)
+			std::deque<std::string>	m_deferred;	// Expensive commands postponed while the server sheds load
+			std::deque<std::unique_ptr<ReplyStream> >	m_reply_streams;	// NAMES/WHO replies generated as the socket drains (oldest first)
+
+			// IRCv3 capability negotiation
+			std::bitset<CAP_COUNT>	m_caps;	// enabled capabilities
+			bool		m_cap_negotiating;		// CAP LS/REQ seen before registration: wait for CAP END
+			int			m_cap_version;			// highest CAP LS version the client announced (0 = none)
 	
 	public:
 			// deleted OCF methods (canonical but disabled): Client manages a unique fd
@@ -57,9 +103,34 @@ class Client
 
 			// = Outgoing data handling (output buffer) =
 			void			appendToOutBuf(const std::string &data);
+			void			appendEntry(const HistoryEntry& entry, const std::string& batch_tag = "");	// recorded message, with the tags this client negotiated
 			const std::string&	getOutBuf() const;
 			void			consumeOutBuf(std::size_t count);
 			bool			hasDataToSend() const;
+			bool			popSentMark(std::uint64_t& enqueued_us);	// pops the oldest block fully taken by send()
+			std::uint64_t	getOldestPendingStamp() const;				// enqueue time of the oldest unsent byte, 0 if none
+			std::uint64_t	getSentBytes() const;						// total bytes taken by send() so far
+
+			// = Broadcast log cursors (pulled into the output buffer as the socket drains) =
+			void			subscribeLog(Channel* channel, std::uint64_t next_seq);
+			void			unsubscribeLog(Channel* channel);			// delivers what is left to read first
+			void			skipLogEntry(Channel* channel, std::uint64_t seq);	// our own message: step over it if it is next
+			bool			hasLogBacklog() const;
+			bool			isLogOverrun() const;						// a cursor points at entries the ring already evicted
+			void			pullLogs(std::size_t high_water);			// copy log entries, oldest msgid first, up to high_water queued bytes
+			void			parkOnLogs();								// ask every subscribed channel to wake us on its next append
+			std::uint64_t	takeLogDropped();
+
+			// = Deferred commands (load shedding) =
+			void			deferCommand(const std::string& raw);
+			std::size_t		getDeferredCount() const;
+			std::string		takeDeferredCommand();				// pops the oldest deferred command
+
+			// = Streamed replies (filled by Server::pumpReplyStreams) =
+			void			pushReplyStream(std::unique_ptr<ReplyStream> stream);
+			bool			hasReplyStream() const;
+			ReplyStream&	frontReplyStream();
+			void			popReplyStream();
 
 			// = Connection state =
 			void			markPeerClosed();
@@ -71,9 +142,22 @@ class Client
 			// Additional helper to clear input buffer (if needed) 30.12.2025
 			// void clearInBuf() { m_inbuf.clear(); }
 
+			// = IRCv3 capabilities =
+			bool			hasCap(Capability cap) const;
+			void			setCap(Capability cap, bool enabled);
+			void			setCapNegotiating(bool negotiating);
+			bool			isCapNegotiating() const;
+			void			setCapVersion(int version);
+			int				getCapVersion() const;
+
 			// User mode management
 			const std::string&	getUserModes() const { return m_user_modes; }
 			void				setUserMode(char mode, bool add);
 			bool				hasUserMode(char mode) const;
+
+	private:
+			void			queueOutput(const std::string &data);
+			void			queueOutput(const char* data, std::size_t size);
+			void			queueEntry(const HistoryEntry& entry, const std::string& batch_tag);
 };
 #endif
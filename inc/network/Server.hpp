@@ -5,9 +5,12 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <ostream>
+#include <csignal>
 #include <sys/poll.h>
 #include "Client.hpp"
 #include "Channel.hpp"
+#include "utils/Metrics.hpp"
 
 class CommandHandler;
 
@@ -25,14 +28,62 @@ class Server
 			std::vector<pollfd>	m_poll_fds;								// all descriptors tracked by poll()
 			std::map<int, std::unique_ptr<Client>>	m_clients;			// fd→Client; one owner, auto cleanup (whithout delete), no leaks, exception-safe - if cnst/function throws, memory freed automatically
 			std::map<std::string, std::unique_ptr<Channel>>	m_channels;	// name→Channel; server owns, auto-cleanup on erase/destruction
+			std::map<std::string, Client*>	m_nicknames;				// nickname→Client index, kept by updateNickname()/disconnectClient()
 			std::unique_ptr<CommandHandler>	m_cmd_handler;
 
+			// Metrics
+			LatencyHistogram	m_outq_residence;					// enqueue -> send() latency of output blocks (us)
+			volatile std::sig_atomic_t	m_metrics_requested;		// set from signal handler, served by run()
+			volatile std::sig_atomic_t	m_trace_toggle_requested;	// same, starts/stops a trace session
+			volatile std::sig_atomic_t	m_stop_requested;			// same, graceful shutdown (SIGINT/SIGTERM)
+
+			// Event-loop lag monitor (per-iteration phase timings, microseconds)
+			struct LoopTick {
+				std::uint64_t	accept_us;
+				std::uint64_t	recv_us;
+				std::uint64_t	dispatch_us;
+				std::uint64_t	send_us;
+			};
+			LoopTick			m_tick;							// accumulators for the current iteration
+			LatencyHistogram	m_phase_poll;
+			LatencyHistogram	m_phase_accept;
+			LatencyHistogram	m_phase_recv;
+			LatencyHistogram	m_phase_dispatch;
+			LatencyHistogram	m_phase_send;
+			LatencyHistogram	m_loop_busy;					// iteration time minus poll()
+
+			// Load shedding state
+			bool			m_shedding;							// overloaded: no accept, deferred WHO, small read budget
+			std::uint64_t	m_window_start;						// start of the current load window (0 = none yet)
+			std::uint64_t	m_window_busy_us;					// busy time accumulated in the current window
+			std::uint64_t	m_busy_permille;					// busy fraction of the last finished window
+			std::uint64_t	m_shed_since;						// when the current shedding period started
+			std::uint64_t	m_shed_enter_count;
+			std::uint64_t	m_shed_total_us;					// time spent shedding (finished periods)
+
+			std::size_t		m_max_targets;						// PRIVMSG/NOTICE targets per command (IRCSERV_MAXTARGETS)
+
+			// Broadcast log (IRCSERV_LOG_MEMBERS, IRCSERV_LAG_POLICY)
+			std::size_t		m_log_min_members;					// channels this big switch to the broadcast log (0 = never)
+			bool			m_lag_disconnect;					// lag policy: true disconnects a member the log left behind, false drops its missed lines
+			std::uint64_t	m_log_dropped;						// log lines skipped for lagging members
+			std::uint64_t	m_lag_disconnects;					// members disconnected by the lag policy
+
 			void	initSocket(const std::string &port);
+			void	configureFromEnv();
 			void	acceptClient();
 			bool	receiveData(int fd);
+			void	processCommands(Client& client);
+			void	pumpReplyStreams(Client& client);
 			void	sendData(int fd);
 			void	disconnectClient(int fd);
 			void	cleanupDisconnectedClients();
+			void	dumpMetrics(std::ostream& os) const;
+			void	updateLoadState(std::uint64_t iter_start, std::uint64_t busy_us, std::uint64_t now);
+			void	enterShedding(std::uint64_t now);
+			void	leaveShedding(std::uint64_t now);
+			void	replayDeferredCommands();
+			void	toggleTracing();
 	
 	public:
 			// Deleted OCF methods (canonical but disabled)
@@ -41,12 +92,22 @@ class Server
 			Server&	operator=(const Server& other) = delete;
 			
 			Server(const std::string &port, const std::string &password);
+			explicit Server(const std::string &password);					// no listener: clients come from attachClient()
 			~Server();
 			void		run();
+			int			runOnce(int timeout_ms);							// one poll() + dispatch iteration
+			bool		attachClient(int fd);								// serve an already connected socket
 			void		stop();
+			void		requestStop();										// async-signal-safe, run() calls stop()
+			void		requestMetricsDump();								// async-signal-safe
+			bool		isShedding() const;
+			std::size_t	getLogMinMembers() const;
+			std::size_t	getMaxTargets() const;
+			void		requestTraceToggle();								// async-signal-safe
 			const std::map<int, std::unique_ptr<Client>>& getClients() const;
 			Channel*	findChannel(const std::string& name);
 			Client*		findClientByNickname(const std::string& nickname);
+			void		updateNickname(Client& client, const std::string& nickname);	// sets the nick and keeps the index in sync
 			void		addClient(int fd, std::unique_ptr<Client> client);
 			Channel*	createChannel(const std::string& name);
 			void		removeChannel(const std::string& name);
@@ -2,9 +2,11 @@
 #define COMMANDHANDLER_HPP
 
 #include "network/Client.hpp"
+#include "network/Channel.hpp"
 #include "Parser.hpp"
 #include "MessageBuilder.hpp"
 #include <map>
+#include <set>
 #include <memory>
 #include <cctype>
 
@@ -24,6 +26,17 @@ class CommandHandler {
 			const	std::string& m_password;
 			const	std::string m_server_name;
 
+			// load shedding counters
+			std::size_t	m_deferred_count;		// expensive commands postponed while shedding
+			std::size_t	m_fanout;				// messages queued by the command being dispatched (probe data)
+			std::uint64_t	m_next_msgid;		// msgid of the next message recorded in a channel history
+			std::set<int>	m_log_wakeups;		// scratch: members woken by a broadcast log append
+			std::vector<std::uint64_t>	m_relay_marks;	// fd -> last relay round that reached it (multi-target dedup)
+			std::uint64_t	m_relay_round;
+			HistoryEntry	m_direct_entry;		// scratch: tagged copy of the private message being relayed
+			int			m_held_pollout_fd;		// client of a JOIN/PART list being dispatched (-1 = none)
+			std::uint64_t	m_next_batch;		// next IRCv3 BATCH reference
+
 			// IRC command handler
 			void	handlePass(Client& client, const Message& msg);
 			void	handleNick(Client& client, const Message& msg);
@@ -39,7 +52,18 @@ class CommandHandler {
 			void	handleMode(Client& client, const Message& msg);
 			void	handleCap(Client& client, const Message& msg);
 			void	handleWho(Client& client, const Message& msg);
+			void	handleNames(Client& client, const Message& msg);
 			void	handleNotice(Client& client, const Message& msg);
+			void	handleChatHistory(Client& client, const Message& msg);
+
+			// JOIN/PART list members
+			void	joinChannel(Client& client, const std::string& channel_name, const std::string& key);
+			void	partChannel(Client& client, const std::string& channel_name, const std::string& reason);
+
+			// PRIVMSG/NOTICE delivery
+			void	relayMessage(Client& client, const std::string& command, const std::string& targets, const std::string& text, bool send_errors);
+			Channel*	resolveRelayChannel(Client& client, const std::string& name, bool send_errors);
+			bool	claimRecipient(int fd, const std::vector<Channel*>& log_channels);
 			
 			// MODE helpers
 			void	handleUserMode(Client& client, const Message& msg, const std::string& target);
@@ -49,13 +73,27 @@ class CommandHandler {
 			bool	isNicknameInUse(const std::string& nickname, int exclude_fd = -1);
 			bool	isValidNickname(const std::string& nickname);
 			bool	isValidChannelName(const std::string& name);
+			bool	isExpensiveCommand(const std::string& command) const;
 
 			// response helpers
+			void	tryRegister(Client& client);
 			void	sendWelcome(Client& client);
+			void	sendCapList(Client& client, const std::string& head, const std::vector<std::string>& caps);
 			void	sendReply(Client& client, const std::string& reply);
+			void	sendEntry(Client& client, const HistoryEntry& entry, const std::string& batch_tag = "");
+			std::string	newBatchRef(Client& client);
+			void	holdPollout(Client& client);
+			void	releasePollout(Client& client);
 			void	sendError(Client& client, int error_code, const std::string& param, const std::string& message);
 			void	sendNumeric(Client& client, int numeric_code, const std::string& message);
+			void	sendFail(Client& client, const std::string& command, const std::string& code, const std::string& context, const std::string& message);
+			void	sendNames(Client& client, const std::string& channel_name);
 			void	broadcastToChannel(Channel& channel, const std::string& message, int exclude_fd = -1);
+			const HistoryEntry&	broadcastWithHistory(Channel& channel, const std::string& message, int exclude_fd = -1);
+			const HistoryEntry&	tagDirectMessage(const std::string& line);
+			void	wakeMembers(Channel& channel, int exclude_fd);
+			void	broadcastMembership(Channel& channel, Client& actor, const std::string& message, int exclude_fd = -1);
+			void	quitChannels(Client& client, const std::string& reason);
 	public:
 			CommandHandler(Server& server, const std::string& password);		// Constructor for command handler
 			~CommandHandler() = default;										// Destructor
@@ -64,6 +102,9 @@ class CommandHandler {
 			CommandHandler& operator=(const CommandHandler&) = delete;
 
 			void handleCommand(const std::string& raw_command, Client& client);	// Process a complete IRC command from client
+			void handleConnectionLost(Client& client);							// Leave all channels before the Client is destroyed
+
+			std::size_t	getDeferredCount() const;
 
 };
 
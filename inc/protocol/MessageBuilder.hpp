@@ -2,15 +2,17 @@
 #define MESSAGEBUILDER_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iomanip>
 #include <sstream>
 #include <stdexcept>
+#include <cstdint>
 
 /**
  * @brief IRC message structures and builder utilities
  * 
- * IRC message format: [:<prefix>] <command> [<params>] [:<trailing>]
+ * IRC message format: [@<tags>] [:<prefix>] <command> [<params>] [:<trailing>]
  * Example: :tanja!user@host PRIVMSG #channel :Hello everyone!
  * 
  * Provides Message structure for parsed IRC messages and MessageBuilder
@@ -19,11 +21,13 @@
 
 // Parsed IRC message structure
 struct Message {
+	std::string_view			tags;					// IRCv3 tag section without '@' (view into the parsed line, valid while it lives)
 	std::string					prefix;					// Optional prefix indicating the source of the message
 	std::string					command;				// IRC command (always required)
 	std::vector<std::string>	params;					// List of parameters (excluding trailing)
 	std::string					trailing;				// trailing parameter (optional)
 
+	bool						getTag(std::string_view key, std::string& value) const;	// unescapes the value on lookup
 	bool						hasPrefix() const;
 	bool						hasTrailing() const;
 	size_t						getTotalParams() const;
@@ -49,6 +53,19 @@ class MessageBuilder {
 
 			// Build command message from server (JOIN, PART, PRIVMSG, etc.)
 			static std::string	buildCommandMessage(const std::string& prefix, const std::string& command, const std::vector<std::string>& params, const std::string& trailing = "");
+
+			// IRCv3 server-time (YYYY-MM-DDThh:mm:ss.sssZ, UTC) to and from milliseconds since the epoch
+			static std::string	formatServerTime(std::uint64_t time_ms);
+			static bool			parseServerTime(const std::string& text, std::uint64_t& time_ms);
+
+			// IRCv3 message tags: append "@key=value" or ";key=value" (value escaped) to a tag section under construction
+			static void			appendTag(std::string& tags, const std::string& key, const std::string& value = "");
+			static std::string	unescapeTagValue(std::string_view value);
+
+			// "@msgid=<id>;time=<server-time> <message>" into out, reusing its capacity; returns the tag section
+			// size (with the space), time_pos receives the offset of "time=" (the last tag)
+			static std::size_t	buildTaggedLine(std::string& out, std::uint64_t msgid, std::uint64_t time_ms,
+									const std::string& message, std::size_t& time_pos);
 };
 
 #endif
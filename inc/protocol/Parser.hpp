@@ -10,11 +10,12 @@
  * @brief IRC protocol message Parser
  * 
  * Parses raw IRC messages into structured Message format according to
- * RFC 1459 specifications. Handles prefix extraction, command parsing,
+ * RFC 1459 specifications. Handles IRCv3 tags, prefix extraction, command parsing,
  * and parameter separation.
  */
 class Parser {
 	private:
+			static std::size_t	extractTags(const std::string& raw, std::string_view& tags);										// Split off the IRCv3 tag section (kept as a view into raw)
 			static std::string	stripCRLF(const std::string& str);																	// Remove \r\n from the end of the string
 			static std::string	extractPrefix(std::string& line);																	// Extract prefix from the message
 			static std::string	extractCommand(std::string& line);																	// Extract command from the message
@@ -26,7 +27,7 @@ class Parser {
 			Parser(const Parser&) = delete;
 			Parser&				operator=(const Parser&) = delete;
 
-			// Parse a raw IRC message into Message structure
+			// Parse a raw IRC message into Message structure (Message::tags points into raw)
 			static Message		parse(const std::string& raw);
 
 };
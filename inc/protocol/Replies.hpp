@@ -13,6 +13,7 @@
 #define RPL_YOURHOST			002
 #define RPL_CREATED				003
 #define RPL_MYINFO				004
+#define RPL_ISUPPORT			005
 #define RPL_UMODEIS				221
 #define RPL_ENDOFWHO			315
 #define RPL_CHANNELMODEIS		324
@@ -27,6 +28,8 @@
 #define ERR_NOSUCHNICK			401
 #define ERR_NOSUCHCHANNEL		403
 #define ERR_CANNOTSENDTOCHAN	404
+#define ERR_TOOMANYTARGETS		407
+#define ERR_INVALIDCAPCMD		410
 #define ERR_NORECIPIENT			411
 #define ERR_NOTEXTTOSEND		412
 #define ERR_UNKNOWNCOMMAND		421
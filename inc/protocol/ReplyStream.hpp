@@ -0,0 +1,64 @@
+#ifndef REPLYSTREAM_HPP
+#define REPLYSTREAM_HPP
+
+#include <string>
+#include <cstddef>
+
+class Server;
+class Client;
+
+/**
+ * @brief Resumable generator for replies that grow with channel size (NAMES, WHO)
+ *
+ * Instead of materializing one line per member into the requester's output
+ * buffer at once, a handler attaches a stream to the client and the server
+ * calls fill() whenever that buffer runs low (Server::pumpReplyStreams).
+ * Streams keep only a resume point and look the channel up again on every
+ * call, so joins, parts or the channel disappearing between two refills are
+ * safe. Memory per pending reply is O(1) plus at most one refill of output.
+ * Clients with the batch capability get the reply framed as one IRCv3 BATCH
+ * (opened by the first fill, closed after the end numeric).
+ */
+class ReplyStream {
+	protected:
+			Server&				m_server;
+			const std::string	m_server_name;
+			const std::string	m_channel;
+			const std::string	m_batch;				// batch reference ("" = not batched)
+			const std::string	m_tags;					// "@batch=<ref> " in front of every line, or ""
+			bool				m_batch_open;
+
+			void	openBatch(Client& client, const char* type);	// BATCH +<ref> <type> <channel>, once
+			void	closeBatch(Client& client);						// BATCH -<ref>
+
+	public:
+			ReplyStream(Server& server, const std::string& server_name, const std::string& channel, const std::string& batch);
+			virtual ~ReplyStream();
+			ReplyStream(const ReplyStream&) = delete;
+			ReplyStream&	operator=(const ReplyStream&) = delete;
+
+			// Append lines until high_water bytes are queued for client; true once complete (end numeric queued)
+			virtual bool	fill(Client& client, std::size_t high_water) = 0;
+};
+
+// RPL_NAMREPLY lines copied from the channel's cached name blocks, then RPL_ENDOFNAMES
+class NamesStream : public ReplyStream {
+	private:
+			std::size_t	m_next_block;				// resume point: index into Channel::getNamesBlocks()
+
+	public:
+			NamesStream(Server& server, const std::string& server_name, const std::string& channel, const std::string& batch);
+			bool	fill(Client& client, std::size_t high_water);
+};
+
+// One RPL_WHOREPLY per member, then RPL_ENDOFWHO
+class WhoStream : public ReplyStream {
+	private:
+			int			m_last_fd;					// resume point: last member emitted (-1 = not started)
+
+	public:
+			WhoStream(Server& server, const std::string& server_name, const std::string& channel, const std::string& batch);
+			bool	fill(Client& client, std::size_t high_water);
+};
+
+#endif
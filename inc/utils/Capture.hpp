@@ -0,0 +1,46 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Inbound traffic capture for deterministic replay (bench/ircbench replay)
+ * 
+ * Enabled by starting the server with IRCSERV_CAPTURE=<file>. Every accepted
+ * connection gets a capture id (fds are reused, ids are not); every inbound
+ * line handed to the command handler is recorded with its arrival time.
+ * 
+ * File format: the magic "IRCCAP1\n", then records of
+ *     type:u8  delta_us:varint  conn:varint  payload
+ * where delta_us is relative to the previous record and payload is
+ *     OPEN  (1)  -
+ *     LINE  (2)  len:varint bytes          (line without CRLF)
+ *     CLOSE (3)  bytes_out:varint          (bytes the server sent on this connection)
+ * Varints are LEB128 (7 bits per byte, low bits first).
+ * 
+ * Captured lines include PASS and private messages: treat capture files as secrets.
+ */
+class Capture {
+	public:
+			enum RecordType {
+				Open = 1,
+				Line = 2,
+				Close = 3
+			};
+
+			Capture() = delete;
+			~Capture() = delete;
+			Capture(const Capture&) = delete;
+			Capture&		operator=(const Capture&) = delete;
+
+			static bool		start(const std::string& path);		// false if the file cannot be opened
+			static void		stop();								// flush and close
+			static bool		isActive();
+
+			static void		recordOpen(int fd);
+			static void		recordLine(int fd, const std::string& line);
+			static void		recordClose(int fd, std::uint64_t bytes_out);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef FAULTINJECTION_HPP
+#define FAULTINJECTION_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/**
+ * @brief Deterministic fault injection around recv/send/accept
+ * 
+ * Compiled into the socket calls only with -DIRCSERV_FAULT_INJECTION (`make faults`);
+ * otherwise IRC_RECV/IRC_SEND/IRC_ACCEPT are the plain system calls.
+ * 
+ * Configured from IRCSERV_FAULTS, a comma list of key=value:
+ * 		seed=N		PRNG seed (default 1): same seed + same traffic = same faults
+ * 		short=P		probability of a short recv/send (random 1..len-1 bytes)
+ * 		eagain=P	spurious EAGAIN (recv/send/accept)
+ * 		eintr=P		EINTR (recv/send/accept)
+ * 		reset=P		ECONNRESET (recv/send), ECONNABORTED (accept)
+ * Example: IRCSERV_FAULTS=seed=7,short=0.3,eagain=0.05,eintr=0.05,reset=0.001 ./ircserv 6667 pass
+ * 
+ * Short sends emulate slow readers: sendData must keep the rest queued and
+ * re-arm POLLOUT; spurious EAGAIN/EINTR exercise the retry paths.
+ */
+class FaultInjection {
+	public:
+			enum Kind {
+				Short = 0,
+				Again,
+				Intr,
+				Reset,
+				KIND_COUNT
+			};
+
+			FaultInjection() = delete;
+			~FaultInjection() = delete;
+			FaultInjection(const FaultInjection&) = delete;
+			FaultInjection&		operator=(const FaultInjection&) = delete;
+
+			static void			configureFromEnv();							// parse IRCSERV_FAULTS (called once at startup)
+			static bool			isEnabled();								// any non-zero rate
+			static ssize_t		recv(int fd, void* buf, std::size_t len, int flags);
+			static ssize_t		send(int fd, const void* buf, std::size_t len, int flags);
+			static int			accept(int fd, sockaddr* addr, socklen_t* addr_len);
+			static std::uint64_t	getInjected(Kind kind);
+			static void			print(std::ostream& os);					// one metrics line
+};
+
+#ifdef IRCSERV_FAULT_INJECTION
+#	define IRC_RECV		FaultInjection::recv
+#	define IRC_SEND		FaultInjection::send
+#	define IRC_ACCEPT	FaultInjection::accept
+#else
+#	define IRC_RECV		::recv
+#	define IRC_SEND		::send
+#	define IRC_ACCEPT	::accept
+#endif
+
+#endif
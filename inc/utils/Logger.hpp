@@ -0,0 +1,53 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Asynchronous, non-blocking logger for the event loop
+ * 
+ * log() formats the message straight into a slot of a fixed-size lock-free
+ * ring (bounded MPMC queue, single consumer in practice) and returns; a
+ * background writer thread drains the ring to stderr in batches. The caller
+ * never waits on terminal or pipe I/O:
+ * 		- ring full          -> message dropped, dropped counter incremented
+ * 		- same call site too often -> duplicates suppressed for the rest of the
+ * 		  1 s window, a summary line is emitted when the window rolls over
+ * 
+ * Before start() (or after stop()) log() writes synchronously, so tools that
+ * link the server objects without a writer thread still see their errors.
+ * 
+ * Usage: LOGE("recv() failed on fd %d: %s", fd, std::strerror(errno));
+ */
+class Logger {
+	public:
+			enum Level { Debug = 0, Info = 1, Warn = 2, Error = 3 };
+
+			Logger() = delete;
+			~Logger() = delete;
+			Logger(const Logger&) = delete;
+			Logger&				operator=(const Logger&) = delete;
+
+			static void			start(Level min_level = Info);		// spawn the writer thread
+			static void			stop();								// drain the ring and join the writer
+			static void			setLevel(Level min_level);
+
+			// site identifies the call site (file:line literal) for duplicate suppression, NULL disables it
+			static void			log(Level level, const char* site, const char* fmt, ...)
+									__attribute__((format(printf, 3, 4)));
+
+			static std::uint64_t	getDroppedCount();
+			static std::uint64_t	getSuppressedCount();
+};
+
+#define LOGGER_STR2(x) #x
+#define LOGGER_STR(x) LOGGER_STR2(x)
+#define LOGGER_SITE __FILE__ ":" LOGGER_STR(__LINE__)
+
+#define LOGD(...) Logger::log(Logger::Debug, LOGGER_SITE, __VA_ARGS__)
+#define LOGI(...) Logger::log(Logger::Info, LOGGER_SITE, __VA_ARGS__)
+#define LOGW(...) Logger::log(Logger::Warn, LOGGER_SITE, __VA_ARGS__)
+#define LOGE(...) Logger::log(Logger::Error, LOGGER_SITE, __VA_ARGS__)
+
+#endif
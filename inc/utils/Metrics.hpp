@@ -0,0 +1,49 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+/**
+ * @brief Lightweight in-process metrics used by the event loop
+ * 
+ * Clock gives a cheap monotonic timestamp in microseconds, LatencyHistogram
+ * keeps a fixed array of log2 buckets. Recording is O(1) and never allocates,
+ * so both are safe to call from the hot path (send/recv/dispatch).
+ */
+class Clock {
+	public:
+			Clock() = delete;
+			~Clock() = delete;
+			Clock(const Clock&) = delete;
+			Clock&				operator=(const Clock&) = delete;
+
+			static std::uint64_t	nowMicros();						// steady_clock in microseconds
+			static std::uint64_t	wallMillis();						// system_clock in milliseconds since the epoch (message timestamps)
+};
+
+class LatencyHistogram {
+	private:
+			static const std::size_t	BUCKETS = 40;					// bucket i holds values in [2^(i-1), 2^i) us, bucket 0 holds 0
+			std::uint64_t	m_buckets[BUCKETS];
+			std::uint64_t	m_count;
+			std::uint64_t	m_sum;
+			std::uint64_t	m_max;
+
+	public:
+			LatencyHistogram();
+			~LatencyHistogram() = default;
+			LatencyHistogram(const LatencyHistogram&) = default;
+			LatencyHistogram&	operator=(const LatencyHistogram&) = default;
+
+			void			record(std::uint64_t value_us);
+			void			reset();
+			std::uint64_t	getCount() const;
+			std::uint64_t	getMax() const;
+			std::uint64_t	getMean() const;
+			std::uint64_t	percentile(double p) const;		// upper bound of the bucket holding the p-th value (p in 0..1)
+			void			print(std::ostream& os, const char* name) const;
+};
+
+#endif
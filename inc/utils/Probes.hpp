@@ -0,0 +1,86 @@
+#ifndef PROBES_HPP
+#define PROBES_HPP
+
+/**
+ * @brief USDT (SystemTap SDT) static probe points, provider "ircserv"
+ * 
+ * Each probe compiles to a single nop plus an ELF note in .note.stapsdt
+ * describing where its arguments live, so there is no cost unless a
+ * tracer (bpftrace, perf, systemtap) attaches and turns the nop into a trap.
+ * 
+ * Probes (all arguments are 64-bit, strings are char* - use str() in bpftrace):
+ * 		accept(fd)
+ * 		recv(fd, bytes)
+ * 		send(fd, bytes, pending_after)
+ * 		disconnect(fd)
+ * 		command_start(fd, command)
+ * 		command_done(fd, command, fanout)	fanout = messages queued by the command
+ * 
+ * Example: bpftrace -e 'usdt:./ircserv:ircserv:command_done { @[str(arg1)] = sum(arg2); }'
+ * 
+ * Uses <sys/sdt.h> when available, otherwise emits the same note layout
+ * itself (x86-64 / AArch64). Build with -DIRCSERV_NO_PROBES to compile them out.
+ * `make probes` checks that the notes are present in the binary.
+ */
+
+#if defined(IRCSERV_NO_PROBES)
+#	define IRC_PROBE_ENABLED 0
+#elif defined(__has_include) && __has_include(<sys/sdt.h>)
+#	include <sys/sdt.h>
+#	define IRC_PROBE_ENABLED 1
+#	define IRC_PROBE0(name)					DTRACE_PROBE(ircserv, name)
+#	define IRC_PROBE1(name, x1)				DTRACE_PROBE1(ircserv, name, (long)(x1))
+#	define IRC_PROBE2(name, x1, x2)			DTRACE_PROBE2(ircserv, name, (long)(x1), (long)(x2))
+#	define IRC_PROBE3(name, x1, x2, x3)		DTRACE_PROBE3(ircserv, name, (long)(x1), (long)(x2), (long)(x3))
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+#	define IRC_PROBE_ENABLED 1
+/*
+	Same layout as sys/sdt.h (note type 3, "stapsdt"): probe address, link-time
+	base (_.stapsdt.base, used to adjust for prelink), semaphore (none), provider,
+	name and the argument spec "-8@<operand>" (signed 8 bytes at asm operand).
+*/
+#	define IRC_SDT_PROBE(name, argfmt, ...)												\
+		__asm__ __volatile__ (															\
+			"990: nop\n"																\
+			".pushsection .note.stapsdt,\"\",\"note\"\n"								\
+			".balign 4\n"																\
+			".4byte 992f-991f,994f-993f,3\n"											\
+			"991: .asciz \"stapsdt\"\n"													\
+			"992: .balign 4\n"															\
+			"993: .8byte 990b\n"														\
+			".8byte _.stapsdt.base\n"													\
+			".8byte 0\n"																\
+			".asciz \"ircserv\"\n"														\
+			".asciz \"" #name "\"\n"													\
+			".asciz \"" argfmt "\"\n"													\
+			"994: .balign 4\n"															\
+			".popsection\n"																\
+			".ifndef _.stapsdt.base\n"													\
+			".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"		\
+			".weak _.stapsdt.base\n"													\
+			".hidden _.stapsdt.base\n"													\
+			"_.stapsdt.base: .space 1\n"												\
+			".size _.stapsdt.base,1\n"													\
+			".popsection\n"																\
+			".endif\n"																	\
+			:: __VA_ARGS__)
+#	define IRC_PROBE0(name)					IRC_SDT_PROBE(name, "")
+#	define IRC_PROBE1(name, x1)				IRC_SDT_PROBE(name, "-8@%[_a1]",							\
+												[_a1] "nor" ((long)(x1)))
+#	define IRC_PROBE2(name, x1, x2)			IRC_SDT_PROBE(name, "-8@%[_a1] -8@%[_a2]",				\
+												[_a1] "nor" ((long)(x1)), [_a2] "nor" ((long)(x2)))
+#	define IRC_PROBE3(name, x1, x2, x3)		IRC_SDT_PROBE(name, "-8@%[_a1] -8@%[_a2] -8@%[_a3]",		\
+												[_a1] "nor" ((long)(x1)), [_a2] "nor" ((long)(x2)),	\
+												[_a3] "nor" ((long)(x3)))
+#else
+#	define IRC_PROBE_ENABLED 0
+#endif
+
+#if !IRC_PROBE_ENABLED
+#	define IRC_PROBE0(name)					do {} while (0)
+#	define IRC_PROBE1(name, x1)				do { (void)(x1); } while (0)
+#	define IRC_PROBE2(name, x1, x2)			do { (void)(x1); (void)(x2); } while (0)
+#	define IRC_PROBE3(name, x1, x2, x3)		do { (void)(x1); (void)(x2); (void)(x3); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief On-demand span recorder with Chrome trace-event JSON export
+ * 
+ * While recording, every TraceSpan writes one complete event ("ph":"X")
+ * into a fixed-size ring owned by the calling thread; when the ring is full
+ * the oldest events are overwritten, so memory stays bounded per thread.
+ * Timestamps are raw TSC ticks (rdtsc on x86-64), converted to microseconds
+ * at dump time using a calibration against steady_clock taken over the
+ * recording session. When not recording a span costs one relaxed load.
+ * 
+ * The server toggles recording on SIGUSR2; the second toggle writes
+ * ircserv-trace-<pid>-<n>.json, which opens in Perfetto / chrome://tracing.
+ */
+class Tracer {
+	public:
+			Tracer() = delete;
+			~Tracer() = delete;
+			Tracer(const Tracer&) = delete;
+			Tracer&				operator=(const Tracer&) = delete;
+
+			static void			start();							// clear rings and start recording
+			static void			stop();
+			static std::string	dump();								// write JSON of the last session, returns the file path ("" on error)
+			static bool			isRecording();
+			static std::uint64_t	now();							// raw timestamp (TSC ticks)
+			static void			record(const char* name, const char* arg, std::uint64_t begin, std::uint64_t end);
+
+			static std::atomic<bool>	s_recording;
+};
+
+/**
+ * @brief RAII span: records [construction, destruction) under `name`
+ * @param name Static string (not copied), e.g. "poll"
+ * @param arg Optional detail copied at the end of the span (e.g. command name)
+ */
+class TraceSpan {
+	private:
+			const char*		m_name;
+			const char*		m_arg;
+			std::uint64_t	m_begin;
+			bool			m_active;
+
+	public:
+			explicit TraceSpan(const char* name, const char* arg = NULL)
+				: m_name(name), m_arg(arg), m_begin(0),
+				  m_active(Tracer::s_recording.load(std::memory_order_relaxed))
+			{
+				if (m_active)
+					m_begin = Tracer::now();
+			}
+			~TraceSpan()
+			{
+				if (m_active)
+					Tracer::record(m_name, m_arg, m_begin, Tracer::now());
+			}
+			TraceSpan(const TraceSpan&) = delete;
+			TraceSpan&	operator=(const TraceSpan&) = delete;
+};
+
+#endif
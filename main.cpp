@@ -1,7 +1,11 @@
 #include "network/Server.hpp"
+#include "utils/Logger.hpp"
+#include "utils/Capture.hpp"
+#include "utils/FaultInjection.hpp"
 #include <iostream>
 #include <cstdlib>
 #include <csignal>
+#include <unistd.h>
 
 // Global server pointer for signal handler
 Server* g_server = NULL;
@@ -11,11 +15,30 @@ void signalHandler(int signum)
     (void)signum;//added to avoid unused parameter warning
     if (g_server) 
 	{
-        std::cout << "\nShutting down server...\n";
-        g_server->stop(); //Ctrl+C / kill
+        // Only async-signal-safe calls here: the loop may be in the middle of a disconnect
+        const char msg[] = "\nShutting down server...\n";
+        ssize_t written = write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+        (void)written;
+        g_server->requestStop(); //Ctrl+C / kill
     }
 }
 
+// SIGUSR1: ask the running server to print a metrics snapshot (kill -USR1 <pid>)
+void metricsSignalHandler(int signum)
+{
+    (void)signum;
+    if (g_server)
+        g_server->requestMetricsDump();
+}
+
+// SIGUSR2: start / stop-and-dump a trace session (Chrome trace-event JSON)
+void traceSignalHandler(int signum)
+{
+    (void)signum;
+    if (g_server)
+        g_server->requestTraceToggle();
+}
+
 int main(int ac, char* av[]) 
 {
     if (ac != 3) 
@@ -32,17 +55,28 @@ int main(int ac, char* av[])
     }
     try 
 	{
+        FaultInjection::configureFromEnv();  // no-op unless IRCSERV_FAULTS is set
         Server server(port_str, password);
         g_server = &server;
 
         signal(SIGINT, signalHandler);
         signal(SIGTERM, signalHandler);
+        signal(SIGUSR1, metricsSignalHandler);
+        signal(SIGUSR2, traceSignalHandler);
 
         std::cout << "IRC Server starting on port " << port_str << "\n";
+        Logger::start();  // event loop logs asynchronously from here on
+        // IRCSERV_CAPTURE=<file>: record inbound traffic for bench/ircbench replay
+        const char* capture_path = std::getenv("IRCSERV_CAPTURE");
+        if (capture_path && !Capture::start(capture_path))
+            std::cerr << "Warning: cannot open capture file " << capture_path << "\n";
         server.run();  // Infinite loop with poll()
+        Capture::stop();
+        Logger::stop();
     } 
 	catch (const std::exception& e) 
 	{
+        Logger::stop();
         std::cerr << "Server error: " << e.what() << "\n";
         return 1;
     }
@@ -1,6 +1,25 @@
 #include "network/Channel.hpp"
 #include "network/Client.hpp"
+#include "protocol/MessageBuilder.hpp"
 #include <iostream>
+#include <algorithm>
+
+/*
+  Body bytes per cached RPL_NAMREPLY block. The longest reply prefix is
+  ":ircserv 353 <9-char nick> = <50-char channel> :" (77 bytes), so prefix,
+  block and CRLF always fit in the 512-byte line limit.
+*/
+static const std::size_t NAMES_BLOCK_BYTES = 400;
+
+// History caps per channel: whichever is hit first evicts the oldest entries.
+static const std::size_t HISTORY_MAX_LINES = 256;
+static const std::size_t HISTORY_MAX_BYTES = 64 * 1024;
+// Upper bound of the "@msgid=<20 digits>;time=<24 chars> " section stored in front of each line
+static const std::size_t HISTORY_TAGS_BYTES = 64;
+
+// Same caps once the ring is the broadcast log: how far a member may fall behind before the lag policy applies.
+static const std::size_t LOG_MAX_LINES = 8192;
+static const std::size_t LOG_MAX_BYTES = 1024 * 1024;
 
 // Default constructor: empty channel with all modes disabled.
 Channel::Channel()
@@ -10,40 +29,25 @@ Channel::Channel()
 	  m_members(),
 	  m_operators(),
 	  m_invited(),
+	  m_names_blocks(),
+	  m_names_open(),
+	  m_names_free(),
+	  m_names_block_of(),
+	  m_history(),
+	  m_history_max_lines(HISTORY_MAX_LINES),
+	  m_history_max_bytes(HISTORY_MAX_BYTES),
+	  m_history_head(0),
+	  m_history_count(0),
+	  m_history_bytes(0),
+	  m_history_first_seq(0),
+	  m_broadcast_log(false),
+	  m_log_waiters(),
 	  m_invite_only(false),
 	  m_topic_protected(false),
-	  m_user_limit(0)
-{}
-
-Channel::Channel(const Channel& src)
-	: m_name(src.m_name),
-	  m_topic(src.m_topic),
-	  m_key(src.m_key),
-	  m_members(src.m_members),
-	  m_operators(src.m_operators),
-	  m_invited(src.m_invited),
-	  m_invite_only(src.m_invite_only),
-	  m_topic_protected(src.m_topic_protected),
-	  m_user_limit(src.m_user_limit)
+	  m_user_limit(0),
+	  m_auditorium(false)
 {}
 
-Channel& Channel::operator=(const Channel& rhs)
-{
-	if (this != &rhs)
-	{
-		m_name = rhs.m_name;
-		m_topic = rhs.m_topic;
-		m_key = rhs.m_key;
-		m_members = rhs.m_members;
-		m_operators = rhs.m_operators;
-		m_invited = rhs.m_invited;
-		m_invite_only = rhs.m_invite_only;
-		m_topic_protected = rhs.m_topic_protected;
-		m_user_limit = rhs.m_user_limit;
-	}
-	return *this;
-}
-
 Channel::~Channel() {}
 
 // Set channel topic string visible to members.
@@ -61,19 +65,45 @@ const std::string& Channel::getTopic() const{return m_topic;}
 /*
   Add a member using its fd from Client and store in the map.
   If fd already exists, update the pointer (covers reconnect cases).
+  With the broadcast log on, the member starts reading at the current end of the log.
 */ 
 void Channel::addMember(Client* client)
 {
 	if (!client)
 		return;
+	std::map<int, Client*>::iterator it = m_members.find(client->getFD());
+	if (it != m_members.end())
+	{
+		namesErase(it->first, namesEntry(it->first, it->second->getNickname()));
+		if (m_broadcast_log)
+			it->second->unsubscribeLog(this);
+	}
 	m_members[client->getFD()] = client;
+	namesInsert(client->getFD());
+	if (m_broadcast_log)
+	{
+		client->subscribeLog(this, getHistoryEndSeq());
+		m_log_waiters.insert(client->getFD());
+	}
 }
 
-// Remove a member by fd (used for PART/QUIT) and drop operator rights if present.
+/*
+  Remove a member by fd (used for PART/QUIT) and drop operator rights if present.
+  Log entries the member has not read yet are moved to its output buffer first,
+  so everything broadcast before it left is still delivered.
+*/
 void Channel::removeMember(int fd)
 {
+	std::map<int, Client*>::iterator it = m_members.find(fd);
+	if (it != m_members.end())
+	{
+		namesErase(fd, namesEntry(fd, it->second->getNickname()));
+		if (m_broadcast_log)
+			it->second->unsubscribeLog(this);
+	}
 	m_members.erase(fd);
 	m_operators.erase(fd);
+	m_log_waiters.erase(fd);
 }
 
 // Check whether fd is in the member list.
@@ -85,15 +115,40 @@ const std::map<int, Client*>& Channel::getMembers() const{return m_members;}
 // Check whether the channel is empty.
 bool Channel::isEmpty() const{return m_members.empty();}
 
-// Grant operator status by adding fd to the operator set.
-void Channel::addOperator(int fd){m_operators.insert(fd);}
+// Grant operator status by adding fd to the operator set (cached NAMES entry gets its '@').
+void Channel::addOperator(int fd)
+{
+	std::map<int, Client*>::iterator it = m_members.find(fd);
+	if (it != m_members.end() && !isOperator(fd))
+	{
+		namesErase(fd, namesEntry(fd, it->second->getNickname()));
+		m_operators.insert(fd);
+		namesInsert(fd);
+		return;
+	}
+	m_operators.insert(fd);
+}
 
 // Revoke operator status for the given fd.
-void Channel::removeOperator(int fd){m_operators.erase(fd);}
+void Channel::removeOperator(int fd)
+{
+	std::map<int, Client*>::iterator it = m_members.find(fd);
+	if (it != m_members.end() && isOperator(fd))
+	{
+		namesErase(fd, namesEntry(fd, it->second->getNickname()));
+		m_operators.erase(fd);
+		namesInsert(fd);
+		return;
+	}
+	m_operators.erase(fd);
+}
 
 // Check whether a user is an operator of the channel.
 bool Channel::isOperator(int fd) const{return m_operators.find(fd) != m_operators.end();}
 
+// Operator fds, for fan-out restricted to operators (+u).
+const std::set<int>& Channel::getOperators() const{return m_operators;}
+
 // Set user limit +l (0 or less means no limit).
 void Channel::setUserLimit(int limit){m_user_limit = limit;}
 
@@ -103,6 +158,9 @@ void Channel::setInviteOnly(bool enable){m_invite_only = enable;}
 // Toggle topic protection +t (only operators may change it).
 void Channel::setTopicProtected(bool enable){m_topic_protected = enable;}
 
+// Toggle auditorium mode +u (membership changes of non-operators are only shown to operators).
+void Channel::setAuditorium(bool enable){m_auditorium = enable;}
+
 // Set channel key (password) for mode +k.
 void Channel::setKey(const std::string& key){m_key = key;}
 
@@ -115,6 +173,9 @@ bool Channel::isInviteOnly() const{return m_invite_only;}
 // Check whether +t is enabled.
 bool Channel::isTopicProtected() const{return m_topic_protected;}
 
+// Check whether +u is enabled.
+bool Channel::isAuditorium() const{return m_auditorium;}
+
 // Check whether a key is set (non-empty string).
 bool Channel::hasKey() const{return !m_key.empty();}
 
@@ -149,3 +210,188 @@ void Channel::broadcast(const std::string& message, int exclude_fd)
         it->second->appendToOutBuf(message);
     }
 }
+
+// Same as broadcast() for a recorded message: members get the tags they negotiated.
+void Channel::broadcastEntry(const HistoryEntry& entry, int exclude_fd)
+{
+    for (std::map<int, Client*>::iterator it = m_members.begin(); it != m_members.end(); ++it)
+    {
+        if (it->first != exclude_fd)
+            it->second->appendEntry(entry);
+    }
+}
+
+// Cached RPL_NAMREPLY bodies, in block order. Blocks never move, so readers may resume by index.
+const std::vector<std::string>& Channel::getNamesBlocks() const{return m_names_blocks;}
+
+// Member changed nick (the Client already holds the new one): replace its cached NAMES entry.
+void Channel::renameMember(int fd, const std::string& old_nick)
+{
+	if (!isMember(fd))
+		return;
+	namesErase(fd, namesEntry(fd, old_nick));
+	namesInsert(fd);
+}
+
+/*
+  Store a broadcast line in the history ring and return the stored entry, so the
+  caller can fan out the very same bytes. The line is kept with its msgid and time
+  tags in front, serialized once for every tag variant (Client::queueEntry).
+  Oldest entries are evicted until both caps hold; a reused slot keeps its string
+  capacity, so once the ring has wrapped recording normally costs a memcpy and no allocation.
+  The sender's cursor (exclude_fd) skips the entry right away when it is caught up,
+  so a member's own messages never count as backlog.
+*/
+const HistoryEntry& Channel::recordHistory(std::uint64_t msgid, std::uint64_t time_ms, const std::string& line, int exclude_fd)
+{
+	while (m_history_count > 0 &&
+		(m_history_count == m_history_max_lines || m_history_bytes + HISTORY_TAGS_BYTES + line.size() > m_history_max_bytes))
+	{
+		m_history_bytes -= m_history[m_history_head].line.size();
+		m_history_head = (m_history_head + 1) % m_history_max_lines;
+		--m_history_count;
+		++m_history_first_seq;
+	}
+	if (m_history_count > 0)
+	{
+		std::uint64_t newest = getHistoryAt(m_history_count - 1).time_ms;
+		if (time_ms < newest)
+			time_ms = newest;
+	}
+	std::size_t slot = (m_history_head + m_history_count) % m_history_max_lines;
+	if (slot == m_history.size())
+		m_history.push_back(HistoryEntry());
+	HistoryEntry& entry = m_history[slot];
+	entry.msgid = msgid;
+	entry.time_ms = time_ms;
+	entry.exclude_fd = exclude_fd;
+	entry.tags_size = MessageBuilder::buildTaggedLine(entry.line, msgid, time_ms, line, entry.time_pos);
+	++m_history_count;
+	m_history_bytes += entry.line.size();
+	if (m_broadcast_log && exclude_fd >= 0)
+	{
+		std::map<int, Client*>::iterator sender = m_members.find(exclude_fd);
+		if (sender != m_members.end())
+			sender->second->skipLogEntry(this, getHistoryEndSeq() - 1);
+	}
+	return entry;
+}
+
+// Number of entries currently held in the history ring.
+std::size_t Channel::getHistorySize() const{return m_history_count;}
+
+// History entry by age, 0 being the oldest one still held.
+const HistoryEntry& Channel::getHistoryAt(std::size_t index) const
+{
+	return m_history[(m_history_head + index) % m_history_max_lines];
+}
+
+// Sequence numbers count every entry ever recorded; cursors use them to detect eviction.
+std::uint64_t Channel::getHistoryFirstSeq() const{return m_history_first_seq;}
+
+std::uint64_t Channel::getHistoryEndSeq() const{return m_history_first_seq + m_history_count;}
+
+/*
+  Switch the channel to the broadcast log (one-way, O(members) once):
+  from now on recordHistory() is the whole fan-out and every member reads
+  the ring through its own cursor when its socket is writable. The ring is
+  unrolled (oldest entry at slot 0) and grows to the log caps.
+*/
+void Channel::enableBroadcastLog()
+{
+	if (m_broadcast_log)
+		return;
+	m_broadcast_log = true;
+	std::rotate(m_history.begin(), m_history.begin() + m_history_head, m_history.end());
+	m_history_head = 0;
+	m_history_max_lines = LOG_MAX_LINES;
+	m_history_max_bytes = LOG_MAX_BYTES;
+	for (std::map<int, Client*>::iterator it = m_members.begin(); it != m_members.end(); ++it)
+	{
+		it->second->subscribeLog(this, getHistoryEndSeq());
+		m_log_waiters.insert(it->first);
+	}
+}
+
+bool Channel::hasBroadcastLog() const{return m_broadcast_log;}
+
+// Member caught up with the log and stopped polling for POLLOUT.
+void Channel::addLogWaiter(int fd)
+{
+	if (isMember(fd))
+		m_log_waiters.insert(fd);
+}
+
+void Channel::takeLogWaiters(std::set<int>& waiters)
+{
+	waiters.clear();
+	waiters.swap(m_log_waiters);
+}
+
+// NAMES entry of a member: "@nick" for operators, "nick" otherwise.
+std::string Channel::namesEntry(int fd, const std::string& nick) const
+{
+	return isOperator(fd) ? "@" + nick : nick;
+}
+
+/*
+  Append the member's entry to a block with room, O(1) amortized:
+  - m_names_free lists blocks that had room; full ones are dropped lazily
+  - no block with room: open a new one at the end
+*/
+void Channel::namesInsert(int fd)
+{
+	std::string entry = namesEntry(fd, m_members[fd]->getNickname());
+	std::size_t idx = m_names_blocks.size();
+	while (!m_names_free.empty())
+	{
+		std::size_t candidate = m_names_free.back();
+		if (m_names_blocks[candidate].size() + 1 + entry.size() <= NAMES_BLOCK_BYTES)
+		{
+			idx = candidate;
+			break;
+		}
+		m_names_open[candidate] = false;
+		m_names_free.pop_back();
+	}
+	if (idx == m_names_blocks.size())
+	{
+		m_names_blocks.push_back(std::string());
+		m_names_open.push_back(true);
+		m_names_free.push_back(idx);
+	}
+	std::string& block = m_names_blocks[idx];
+	if (!block.empty())
+		block += ' ';
+	block += entry;
+	m_names_block_of[fd] = idx;
+}
+
+/*
+  Cut `entry` (and one separating space) out of the member's block, O(block size).
+  A block that drops below half full is offered to namesInsert() again.
+*/
+void Channel::namesErase(int fd, const std::string& entry)
+{
+	std::map<int, std::size_t>::iterator where = m_names_block_of.find(fd);
+	if (where == m_names_block_of.end())
+		return;
+	std::string& block = m_names_blocks[where->second];
+	for (std::size_t pos = block.find(entry); pos != std::string::npos; pos = block.find(entry, pos + 1))
+	{
+		std::size_t end = pos + entry.size();
+		if ((pos != 0 && block[pos - 1] != ' ') || (end != block.size() && block[end] != ' '))
+			continue;
+		if (end != block.size())
+			block.erase(pos, entry.size() + 1);
+		else
+			block.erase(pos == 0 ? 0 : pos - 1, pos == 0 ? entry.size() : entry.size() + 1);
+		break;
+	}
+	if (!m_names_open[where->second] && block.size() < NAMES_BLOCK_BYTES / 2)
+	{
+		m_names_open[where->second] = true;
+		m_names_free.push_back(where->second);
+	}
+	m_names_block_of.erase(where);
+}
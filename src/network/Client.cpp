@@ -1,9 +1,20 @@
 #include "network/Client.hpp"
+#include "network/Channel.hpp"
+#include "protocol/ReplyStream.hpp"
+#include "utils/Metrics.hpp"
+
+// Appends closer together than this share one OutMark (bounds the mark queue under bursts)
+static const std::uint64_t OUT_MARK_TICK_US = 100;
 
 Client::Client(int fd)
 	: m_fd(fd),
 	  m_inbuf(""),
 	  m_outbuf(""),
+	  m_out_marks(),
+	  m_out_appended(0),
+	  m_out_sent(0),
+	  m_log_cursors(),
+	  m_log_dropped(0),
 	  m_nickname(""),
 	  m_username(""),
 	  m_realname(""),
@@ -12,7 +23,12 @@ Client::Client(int fd)
 	  m_peer_closed(false),
 	  m_should_disconnect(false),	// init disconnect flag as false
 	  m_quit_reason(""),			// no quit reason until requested
-	  m_user_modes("")				// user modes start empty
+	  m_user_modes(""),				// user modes start empty
+	  m_deferred(),
+	  m_reply_streams(),
+	  m_caps(),
+	  m_cap_negotiating(false),
+	  m_cap_version(0)
 {}
 
 Client::~Client() {}
@@ -73,9 +89,84 @@ std::string Client::extractNextCmd()
 	return line;
 }
 
-void Client::appendToOutBuf(const std::string &data){m_outbuf += data;}
+/*
+	Queue data for sending. Broadcast log entries still waiting for this client
+	are older than `data`, so they are moved to the output buffer first.
+*/
+void Client::appendToOutBuf(const std::string &data)
+{
+	if (!m_log_cursors.empty())
+		pullLogs(std::string::npos);
+	queueOutput(data);
+}
+
+// Same as appendToOutBuf for a recorded message (see queueEntry); batch_tag is "@batch=<ref>" or "".
+void Client::appendEntry(const HistoryEntry& entry, const std::string& batch_tag)
+{
+	if (!m_log_cursors.empty())
+		pullLogs(std::string::npos);
+	queueEntry(entry, batch_tag);
+}
+
+/*
+	Queue a recorded message in the variant this client negotiated. The stored line is
+	"@msgid=<id>;time=<server-time> <message>", so every variant is a slice of it:
+	message-tags gets the whole line, server-time alone "@" + the time tag onwards,
+	everyone else the bare message. Nothing is serialized per recipient.
+	Inside a batch, the batch tag (built once per batch by MessageBuilder::appendTag)
+	goes first and the slice continues the tag section.
+*/
+void Client::queueEntry(const HistoryEntry& entry, const std::string& batch_tag)
+{
+	const std::string& line = entry.line;
+	if (!batch_tag.empty())
+	{
+		queueOutput(batch_tag);
+		if (hasCap(CAP_MESSAGE_TAGS))
+		{
+			queueOutput(";", 1);
+			queueOutput(line.data() + 1, line.size() - 1);
+			return;
+		}
+		// ";time=..." and " <message>" are already in the line, right before time_pos and tags_size
+		std::size_t from = hasCap(CAP_SERVER_TIME) ? entry.time_pos - 1 : entry.tags_size - 1;
+		queueOutput(line.data() + from, line.size() - from);
+	}
+	else if (hasCap(CAP_MESSAGE_TAGS))
+		queueOutput(line.data(), line.size());
+	else if (hasCap(CAP_SERVER_TIME))
+	{
+		queueOutput("@", 1);
+		queueOutput(line.data() + entry.time_pos, line.size() - entry.time_pos);
+	}
+	else
+		queueOutput(line.data() + entry.tags_size, line.size() - entry.tags_size);
+}
+
+/*
+	Append to the output buffer and stamp it with the enqueue time.
+	Consecutive appends within one tick extend the last mark instead of adding a new one,
+	so the mark queue stays small during broadcast bursts.
+*/
+void Client::queueOutput(const std::string &data)
+{
+	queueOutput(data.data(), data.size());
+}
+
+void Client::queueOutput(const char* data, std::size_t size)
+{
+	if (size == 0)
+		return;
+	m_outbuf.append(data, size);
+	m_out_appended += size;
+	std::uint64_t now = Clock::nowMicros();
+	if (!m_out_marks.empty() && now - m_out_marks.back().enqueued_us < OUT_MARK_TICK_US)
+		m_out_marks.back().end = m_out_appended;
+	else
+		m_out_marks.push_back(OutMark{m_out_appended, now});
+}
 
-bool Client::hasDataToSend() const{return !m_outbuf.empty();}
+bool Client::hasDataToSend() const{return !m_outbuf.empty() || hasLogBacklog();}
 
 const std::string& Client::getOutBuf() const{return m_outbuf;}
 
@@ -83,14 +174,191 @@ void Client::consumeOutBuf(std::size_t count)
 {
 	if (count >= m_outbuf.size())
 	{
+		m_out_sent += m_outbuf.size();
 		m_outbuf.clear();
 		return;
 	}
+	m_out_sent += count;
 	m_outbuf.erase(0, count);
 }
 
+/*
+	Pop the oldest output block whose bytes were all taken by send().
+	Returns false when the oldest block is still (partly) pending.
+*/
+bool Client::popSentMark(std::uint64_t& enqueued_us)
+{
+	if (m_out_marks.empty() || m_out_marks.front().end > m_out_sent)
+		return false;
+	enqueued_us = m_out_marks.front().enqueued_us;
+	m_out_marks.pop_front();
+	return true;
+}
+
+std::uint64_t Client::getSentBytes() const{return m_out_sent;}
+
+// Enqueue time of the oldest byte still waiting in m_outbuf (0 if nothing is pending).
+std::uint64_t Client::getOldestPendingStamp() const
+{
+	for (std::deque<OutMark>::const_iterator it = m_out_marks.begin(); it != m_out_marks.end(); ++it)
+	{
+		if (it->end > m_out_sent)
+			return it->enqueued_us;
+	}
+	return 0;
+}
+
+// Start reading a channel's broadcast log at next_seq (replaces an older cursor on the same channel).
+void Client::subscribeLog(Channel* channel, std::uint64_t next_seq)
+{
+	for (std::size_t i = 0; i < m_log_cursors.size(); ++i)
+	{
+		if (m_log_cursors[i].channel == channel)
+		{
+			m_log_cursors[i].next_seq = next_seq;
+			return;
+		}
+	}
+	m_log_cursors.push_back(LogCursor{channel, next_seq});
+}
+
+void Client::unsubscribeLog(Channel* channel)
+{
+	pullLogs(std::string::npos);
+	for (std::size_t i = 0; i < m_log_cursors.size(); ++i)
+	{
+		if (m_log_cursors[i].channel == channel)
+		{
+			m_log_cursors.erase(m_log_cursors.begin() + i);
+			return;
+		}
+	}
+}
+
+void Client::skipLogEntry(Channel* channel, std::uint64_t seq)
+{
+	for (std::size_t i = 0; i < m_log_cursors.size(); ++i)
+	{
+		if (m_log_cursors[i].channel == channel && m_log_cursors[i].next_seq == seq)
+			++m_log_cursors[i].next_seq;
+	}
+}
+
+bool Client::hasLogBacklog() const
+{
+	for (std::size_t i = 0; i < m_log_cursors.size(); ++i)
+	{
+		if (m_log_cursors[i].next_seq != m_log_cursors[i].channel->getHistoryEndSeq())
+			return true;
+	}
+	return false;
+}
+
+bool Client::isLogOverrun() const
+{
+	for (std::size_t i = 0; i < m_log_cursors.size(); ++i)
+	{
+		if (m_log_cursors[i].next_seq < m_log_cursors[i].channel->getHistoryFirstSeq())
+			return true;
+	}
+	return false;
+}
+
+/*
+	Merge the subscribed logs into m_outbuf in msgid order (msgids are server-wide,
+	so messages from different channels keep the order they were sent in).
+	Entries the ring evicted before we got to them are skipped and counted in m_log_dropped;
+	the server decides whether that costs the connection (see the lag policy in Server).
+	O(subscriptions) per line; entries this client sent itself are skipped, as in Channel::broadcast.
+*/
+void Client::pullLogs(std::size_t high_water)
+{
+	while (m_outbuf.size() < high_water)
+	{
+		LogCursor* next = NULL;
+		const HistoryEntry* next_entry = NULL;
+		for (std::size_t i = 0; i < m_log_cursors.size(); ++i)
+		{
+			LogCursor& cursor = m_log_cursors[i];
+			const Channel& channel = *cursor.channel;
+			if (cursor.next_seq < channel.getHistoryFirstSeq())
+			{
+				m_log_dropped += channel.getHistoryFirstSeq() - cursor.next_seq;
+				cursor.next_seq = channel.getHistoryFirstSeq();
+			}
+			if (cursor.next_seq == channel.getHistoryEndSeq())
+				continue;
+			const HistoryEntry& entry = channel.getHistoryAt(cursor.next_seq - channel.getHistoryFirstSeq());
+			if (!next_entry || entry.msgid < next_entry->msgid)
+			{
+				next = &cursor;
+				next_entry = &entry;
+			}
+		}
+		if (!next)
+			return;
+		++next->next_seq;
+		if (next_entry->exclude_fd != m_fd)
+			queueEntry(*next_entry, "");
+	}
+}
+
+void Client::parkOnLogs()
+{
+	for (std::size_t i = 0; i < m_log_cursors.size(); ++i)
+		m_log_cursors[i].channel->addLogWaiter(m_fd);
+}
+
+std::uint64_t Client::takeLogDropped()
+{
+	std::uint64_t dropped = m_log_dropped;
+	m_log_dropped = 0;
+	return dropped;
+}
+
 const std::string& Client::getInBuf() const{return m_inbuf;}
 
+// Postpone a raw command until the server leaves load shedding mode.
+void Client::deferCommand(const std::string& raw){m_deferred.push_back(raw);}
+
+std::size_t Client::getDeferredCount() const{return m_deferred.size();}
+
+std::string Client::takeDeferredCommand()
+{
+	if (m_deferred.empty())
+		return "";
+	std::string raw = m_deferred.front();
+	m_deferred.pop_front();
+	return raw;
+}
+
+// Queue a streamed reply behind the ones already pending (replies keep command order).
+void Client::pushReplyStream(std::unique_ptr<ReplyStream> stream){m_reply_streams.push_back(std::move(stream));}
+
+bool Client::hasReplyStream() const{return !m_reply_streams.empty();}
+
+ReplyStream& Client::frontReplyStream(){return *m_reply_streams.front();}
+
+void Client::popReplyStream(){m_reply_streams.pop_front();}
+
+// = IRCv3 capabilities =
+bool Client::hasCap(Capability cap) const{return m_caps.test(cap);}
+
+void Client::setCap(Capability cap, bool enabled){m_caps.set(cap, enabled);}
+
+void Client::setCapNegotiating(bool negotiating){m_cap_negotiating = negotiating;}
+
+bool Client::isCapNegotiating() const{return m_cap_negotiating;}
+
+// CAP LS 302 and later: values in LS, implicit cap-notify. Versions only go up.
+void Client::setCapVersion(int version)
+{
+	if (version > m_cap_version)
+		m_cap_version = version;
+}
+
+int Client::getCapVersion() const{return m_cap_version;}
+
 void Client::markPeerClosed(){m_peer_closed = true;}
 
 bool Client::isPeerClosed() const{return m_peer_closed;}
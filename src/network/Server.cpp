@@ -1,13 +1,22 @@
 #include <cstring>        // strerror, memset
 #include <iostream>       // cout, cerr
+#include <sstream>        // metrics snapshot formatting
+#include <cstdlib>        // getenv, strtoul
 #include <cerrno>         // errno
 #include <csignal>        // signal/sigaction (SIGPIPE)
 #include <fcntl.h>        // fcntl (for non-blocking)
 #include <unistd.h>       // close, read, write
 #include <sys/socket.h>   // socket, bind, listen, accept
 #include <netinet/in.h>   // sockaddr_in, htons
+#include <netinet/tcp.h>  // TCP_NODELAY
 #include "network/Server.hpp"
 #include "protocol/CommandHandler.hpp"
+#include "protocol/ReplyStream.hpp"
+#include "utils/Capture.hpp"
+#include "utils/FaultInjection.hpp"
+#include "utils/Logger.hpp"
+#include "utils/Probes.hpp"
+#include "utils/Tracer.hpp"
 
 /*
 EAGAIN/EWOULDBLOCK - no pending connect, non-block and interrupt: no crash -> temp no data, retry later.
@@ -21,6 +30,21 @@ POLLHUP — connection hangup
 fd(0, 1, 2 (stdin, stdout, stderr)
 */
 
+// Lag monitor / load shedding tuning
+static const std::uint64_t	LAG_WINDOW_US = 1000000;		// load is judged over 1 s windows of loop time
+static const std::uint64_t	SHED_ENTER_PERMILLE = 900;		// enter shedding when a window was >= 90% busy
+static const std::uint64_t	SHED_LEAVE_PERMILLE = 500;		// leave shedding when a window was < 50% busy
+static const int			SHED_POLL_TIMEOUT_MS = 100;		// periodic wakeup while shedding
+static const std::size_t	READ_BUDGET = 65536;			// max bytes read per client per wakeup
+static const std::size_t	SHED_READ_BUDGET = 4096;		// same, while shedding
+static const std::size_t	REPLY_HIGH_WATER = 8192;		// streamed NAMES/WHO are refilled up to this many queued bytes
+
+// PRIVMSG/NOTICE target list limit (overridden by IRCSERV_MAXTARGETS, advertised as MAXTARGETS)
+static const std::size_t	MAX_TARGETS = 8;
+
+// Broadcast log defaults (overridden by IRCSERV_LOG_MEMBERS / IRCSERV_LAG_POLICY)
+static const std::size_t	LOG_MIN_MEMBERS = 1000;			// channel size at which fan-out switches to the broadcast log
+
 /*
 ignore SIGPIPE to prevent server crash on writing to closed socket.
 */
@@ -88,6 +112,29 @@ static void disable_pollevent(std::vector<pollfd> &poll_fds, int fd, short flag)
 	}
 }
 
+/*
+   Re-enable specified poll event for given fd
+*/
+static void enable_pollevent(std::vector<pollfd> &poll_fds, int fd, short flag)
+{
+	for (size_t i = 0; i < poll_fds.size(); ++i)
+	{
+		if (poll_fds[i].fd == fd)
+		{
+			poll_fds[i].events = poll_fds[i].events | flag;
+			return;
+		}
+	}
+}
+
+/*
+   A client waits for a streamed reply or a deferred command before its next command runs
+*/
+static bool commands_paused(const Client &client)
+{
+	return client.hasReplyStream() || client.getDeferredCount() > 0;
+}
+
 /*
 	Constructor sets up the listening socket and poll tracking:
 	- Ignore SIGPIPE to avoid crashing on write to closed sockets
@@ -97,9 +144,14 @@ static void disable_pollevent(std::vector<pollfd> &poll_fds, int fd, short flag)
 	- On any init failure, close the socket and rethrow to signal construction error
 */
 Server::Server(const std::string& port, const std::string& password)
-	: m_listen_fd(-1), m_running(true), m_password(password)
+	: m_listen_fd(-1), m_running(true), m_password(password), m_metrics_requested(0), m_trace_toggle_requested(0), m_stop_requested(0),
+	  m_tick(), m_shedding(false), m_window_start(0), m_window_busy_us(0), m_busy_permille(0), m_shed_since(0),
+	  m_shed_enter_count(0), m_shed_total_us(0),
+	  m_max_targets(MAX_TARGETS),
+	  m_log_min_members(LOG_MIN_MEMBERS), m_lag_disconnect(true), m_log_dropped(0), m_lag_disconnects(0)
 {
 	ignore_sigpipe();
+	configureFromEnv();
 	try {
 		initSocket(port);
 		// Create CommandHandler after successful socket init
@@ -121,6 +173,22 @@ Server::Server(const std::string& port, const std::string& password)
 	}
 }
 
+/*
+	Embedded server without a listening socket (benchmark harnesses, tests):
+	connections are handed in with attachClient() and the loop is driven with runOnce().
+*/
+Server::Server(const std::string& password)
+	: m_listen_fd(-1), m_running(true), m_password(password), m_metrics_requested(0), m_trace_toggle_requested(0), m_stop_requested(0),
+	  m_tick(), m_shedding(false), m_window_start(0), m_window_busy_us(0), m_busy_permille(0), m_shed_since(0),
+	  m_shed_enter_count(0), m_shed_total_us(0),
+	  m_max_targets(MAX_TARGETS),
+	  m_log_min_members(LOG_MIN_MEMBERS), m_lag_disconnect(true), m_log_dropped(0), m_lag_disconnects(0)
+{
+	ignore_sigpipe();
+	configureFromEnv();
+	m_cmd_handler = std::make_unique<CommandHandler>(*this, m_password);
+}
+
 /*
  unique_ptr automatically frees memory. We do NOT need to delete Client manually.
  1. Close listening socket
@@ -138,9 +206,53 @@ Server::~Server()
 			close(it->first);
 	}
 	m_clients.clear();
+	m_nicknames.clear();
 	m_poll_fds.clear();
 }
 
+/*
+	Tuning from the environment:
+	IRCSERV_MAXTARGETS=<n>                targets per PRIVMSG/NOTICE (at least 1)
+	IRCSERV_LOG_MEMBERS=<n>               channels with at least n members use the broadcast log (0 disables it)
+	IRCSERV_LAG_POLICY=disconnect|drop    what happens to a member whose unread lines the log evicted:
+	                                      disconnect it ("Max SendQ exceeded", default) or skip the lines
+*/
+void Server::configureFromEnv()
+{
+	const char* targets = std::getenv("IRCSERV_MAXTARGETS");
+	if (targets && *targets)
+	{
+		char* end = NULL;
+		unsigned long value = std::strtoul(targets, &end, 10);
+		if (*end == '\0' && value > 0)
+			m_max_targets = static_cast<std::size_t>(value);
+		else
+			std::cerr << "Warning: ignoring invalid IRCSERV_MAXTARGETS=" << targets << "\n";
+	}
+	const char* members = std::getenv("IRCSERV_LOG_MEMBERS");
+	if (members && *members)
+	{
+		char* end = NULL;
+		unsigned long value = std::strtoul(members, &end, 10);
+		if (*end == '\0')
+			m_log_min_members = static_cast<std::size_t>(value);
+		else
+			std::cerr << "Warning: ignoring invalid IRCSERV_LOG_MEMBERS=" << members << "\n";
+	}
+	const char* policy = std::getenv("IRCSERV_LAG_POLICY");
+	if (policy && *policy)
+	{
+		if (std::string(policy) == "disconnect" || std::string(policy) == "drop")
+			m_lag_disconnect = (std::string(policy) == "disconnect");
+		else
+			std::cerr << "Warning: ignoring invalid IRCSERV_LAG_POLICY=" << policy << "\n";
+	}
+}
+
+std::size_t Server::getLogMinMembers() const{return m_log_min_members;}
+
+std::size_t Server::getMaxTargets() const{return m_max_targets;}
+
 /*
   returns nullptr if channel not found
 */ 
@@ -152,15 +264,27 @@ Channel* Server::findChannel(const std::string& name)
 	return it->second.get();
 }
 
+// O(log n) through the nickname index; returns NULL if nobody uses the nick.
 Client* Server::findClientByNickname(const std::string& nickname)
 {
-	for (std::map<int, std::unique_ptr<Client>>::iterator it = m_clients.begin();
-		it != m_clients.end(); ++it)
-	{
-		if (it->second->getNickname() == nickname)
-			return it->second.get();
-	}
-	return NULL;
+	std::map<std::string, Client*>::iterator it = m_nicknames.find(nickname);
+	if (it == m_nicknames.end())
+		return NULL;
+	return it->second;
+}
+
+/*
+	Change a client's nickname (the caller checked it is free) and move its index entry.
+	An empty nickname only removes the client from the index.
+*/
+void Server::updateNickname(Client& client, const std::string& nickname)
+{
+	std::map<std::string, Client*>::iterator old = m_nicknames.find(client.getNickname());
+	if (old != m_nicknames.end() && old->second == &client)
+		m_nicknames.erase(old);
+	client.setNickname(nickname);
+	if (!nickname.empty())
+		m_nicknames[nickname] = &client;
 }
 
 void Server::addClient(int fd, std::unique_ptr<Client> client)
@@ -256,33 +380,56 @@ void Server::acceptClient()
 		socklen_t client_len;
 		
 		client_len = sizeof(client_addr);
-		int client_fd = accept(m_listen_fd, (sockaddr *)&client_addr, &client_len);
+		int client_fd = IRC_ACCEPT(m_listen_fd, (sockaddr *)&client_addr, &client_len);
 		if (client_fd < 0)
 		{
 			// accept() on non-blocking socket: returns -1 when no pending connections - EAGAIN/EWOULDBLOCK means: no more pending connections (normal)
 			if (errno == EAGAIN || errno == EWOULDBLOCK)
 				break;
+			// interrupted, or the peer gave up while queued: the next pending connection may be fine
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
 			// any other error — log it
-			std::cerr << "accept() failed: " << std::strerror(errno) << "\n";
+			LOGE("accept() failed: %s", std::strerror(errno));
 			break;
 		}
-		if (set_non_blocking(client_fd) < 0)// Set client socket non-blocking
-		{
-			std::cerr << "Failed to set client non-blocking, fd " << client_fd << "\n";
+		if (!attachClient(client_fd))
 			close(client_fd);
-			continue;
-		}
-		// Add to poll list
-		pollfd pfd;
-		pfd.fd = client_fd;
-		pfd.events = POLLIN;  // start with only read events
-		pfd.revents = 0;
-		m_poll_fds.push_back(pfd);//push_back копирует структуру pollfd и добавляет в вектор
-		m_clients.emplace(client_fd, std::make_unique<Client>(client_fd)); //without copy constructor
 		// std::cout << "New client accepted, fd = " << client_fd << std::endl;
 	}
 }
 
+/*
+	Start serving an already connected socket (from accept(), or injected by a harness
+	as one end of a socketpair()):
+	- Set it non-blocking
+	- Add fd to poll list with POLLIN
+	- Create Client object for the connection
+	Returns false if the fd cannot be made non-blocking (the caller still owns it).
+*/
+bool Server::attachClient(int client_fd)
+{
+	if (set_non_blocking(client_fd) < 0)// Set client socket non-blocking
+	{
+		LOGE("Failed to set client non-blocking, fd %d", client_fd);
+		return false;
+	}
+	// Replies are written as soon as they are ready: without TCP_NODELAY, Nagle holds small
+	// writes behind the peer's delayed ACK (~40 ms). Fails harmlessly on non-TCP sockets.
+	int one = 1;
+	setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	// Add to poll list
+	pollfd pfd;
+	pfd.fd = client_fd;
+	pfd.events = POLLIN;  // start with only read events
+	pfd.revents = 0;
+	m_poll_fds.push_back(pfd);//push_back копирует структуру pollfd и добавляет в вектор
+	m_clients.emplace(client_fd, std::make_unique<Client>(client_fd)); //without copy constructor
+	IRC_PROBE1(accept, client_fd);
+	Capture::recordOpen(client_fd);
+	return true;
+}
+
 /*
  Remove fd from poll fds
  Close socket (free OS resource)
@@ -290,6 +437,7 @@ void Server::acceptClient()
 */
 void Server::disconnectClient(int fd)
 {
+	IRC_PROBE1(disconnect, fd);
 	for (size_t i = 0; i < m_poll_fds.size(); ++i)
 	{
 		if (m_poll_fds[i].fd == fd)
@@ -301,6 +449,14 @@ void Server::disconnectClient(int fd)
 	if (fd >= 0)
 		close(fd);
 
+	// Channels hold raw Client pointers: leave them before the Client is freed
+	std::map<int, std::unique_ptr<Client>>::iterator it = m_clients.find(fd);
+	if (it != m_clients.end())
+		Capture::recordClose(fd, it->second->getSentBytes());
+	if (it != m_clients.end() && m_cmd_handler)
+		m_cmd_handler->handleConnectionLost(*(it->second));
+	if (it != m_clients.end())
+		updateNickname(*(it->second), "");
 	m_clients.erase(fd);
 	// std::cout << "Client fd " << fd << " disconnected and removed." << std::endl;
 }
@@ -341,18 +497,39 @@ void Server::disablePolloutForFd(int fd)
 	}
 }
 
+/*
+	Drop clients that asked to leave and have flushed their output, and apply the
+	lag policy to members the broadcast log left behind: with "disconnect" they are
+	dropped right away (their pending output is lost anyway), with "drop" the missed
+	lines were already skipped by Client::pullLogs and are only counted.
+*/
 void Server::cleanupDisconnectedClients()
 {
 	if (m_clients.empty())
 		return;
 	std::vector<int> to_disconnect;
+	std::vector<int> lagging;
 	to_disconnect.reserve(m_clients.size());
 	for (std::map<int, std::unique_ptr<Client>>::const_iterator it = m_clients.begin();
 		 it != m_clients.end(); ++it)
 	{
-		if (it->second->shouldDisconnect() && !it->second->hasDataToSend())
+		std::uint64_t dropped = it->second->takeLogDropped();
+		m_log_dropped += dropped;
+		if (m_lag_disconnect && (dropped > 0 || it->second->isLogOverrun()))
+			lagging.push_back(it->first);
+		else if (it->second->shouldDisconnect() && !it->second->hasDataToSend())
 			to_disconnect.push_back(it->first);
 	}
+	for (size_t i = 0; i < lagging.size(); ++i)
+	{
+		std::map<int, std::unique_ptr<Client>>::iterator it = m_clients.find(lagging[i]);
+		if (it == m_clients.end())
+			continue;
+		LOGW("Client fd %d fell behind the broadcast log, disconnecting", lagging[i]);
+		it->second->markForDisconnect("Max SendQ exceeded");
+		++m_lag_disconnects;
+		disconnectClient(lagging[i]);
+	}
 	for (size_t i = 0; i < to_disconnect.size(); ++i)
 		disconnectClient(to_disconnect[i]);
 }
@@ -368,15 +545,19 @@ bool Server::receiveData(int fd)
 {
 	char buffer[4096];
 	ssize_t bytes_read;
-	while (true)
+	// Read budget per wakeup keeps one chatty client from starving the loop;
+	// poll() is level-triggered, so leftover data is picked up next iteration
+	std::size_t budget = m_shedding ? SHED_READ_BUDGET : READ_BUDGET;
+	while (budget > 0)
 	{
-		bytes_read = recv(fd, buffer, sizeof(buffer), 0);
+		bytes_read = IRC_RECV(fd, buffer, sizeof(buffer), 0);
 		if (bytes_read < 0)
 		{
 			if (errno == EAGAIN || errno == EWOULDBLOCK)
 				break;
-			std::cerr << "recv() failed on fd " << fd << ": "
-					  << std::strerror(errno) << std::endl;
+			if (errno == EINTR)
+				continue;
+			LOGE("recv() failed on fd %d: %s", fd, std::strerror(errno));
 			disconnectClient(fd);
 			return false;
 		}
@@ -396,31 +577,82 @@ bool Server::receiveData(int fd)
 			}
 			return true;
 		}
+		IRC_PROBE2(recv, fd, bytes_read);
 		auto it = m_clients.find(fd);
 		if (it == m_clients.end())
 			return false;
 
 		Client &client = *(it->second);
 
+		budget = (static_cast<std::size_t>(bytes_read) >= budget) ? 0 : budget - static_cast<std::size_t>(bytes_read);
 		std::string data(buffer, static_cast<std::size_t>(bytes_read));
-		const std::size_t MAX_INBUF = 8192;
 		if (client.getInBuf().size() + data.size() > MAX_INBUF)
 		{
-			std::cerr << "Input buffer overflow for fd " << fd
-					  << " (limit " << MAX_INBUF << ")\n";
+			LOGW("Input buffer overflow for fd %d (limit %zu)", fd, MAX_INBUF);
 			disconnectClient(fd);
 			return false;
 		}
 		client.appendToInBuf(data);
-		while (client.hasCompleteCmd())
+		processCommands(client);
+		// Reading resumes once the streamed reply has drained (sendData)
+		// or the deferred command was replayed (replayDeferredCommands)
+		if (commands_paused(client))
+			return true;
+	}
+	return true;
+}
+
+/*
+ Dispatch every complete command in the client's input buffer.
+ A command that leaves a streamed reply (NAMES/WHO on a big channel) pauses the client:
+ the rest stays in m_inbuf and POLLIN is dropped, so replies keep command order and
+ a pipelining client is throttled by TCP instead of growing m_inbuf.
+ A command deferred by load shedding pauses the client the same way until the loop
+ recovers; it then runs first, ahead of anything still in m_inbuf.
+*/
+void Server::processCommands(Client& client)
+{
+	int fd = client.getFD();
+	while (!client.hasReplyStream())
+	{
+		std::string cmd;
+		if (client.getDeferredCount() > 0)
 		{
-			std::string cmd = client.extractNextCmd();
-			m_cmd_handler->handleCommand(cmd, client);
-			if (client.hasDataToSend())
-				enablePolloutForFD(fd);
+			if (m_shedding)
+				break;
+			cmd = client.takeDeferredCommand();
 		}
+		else if (client.hasCompleteCmd())
+		{
+			cmd = client.extractNextCmd();
+			Capture::recordLine(fd, cmd);
+		}
+		else
+			break;
+		std::uint64_t dispatch_start = Clock::nowMicros();
+		m_cmd_handler->handleCommand(cmd, client);
+		pumpReplyStreams(client);
+		m_tick.dispatch_us += Clock::nowMicros() - dispatch_start;
+		if (client.hasDataToSend())
+			enablePolloutForFD(fd);
+	}
+	if (commands_paused(client))
+		disable_pollevent(m_poll_fds, fd, POLLIN);
+}
+
+/*
+ Let pending streamed replies generate output until REPLY_HIGH_WATER bytes are queued.
+ Called after dispatch and whenever send() drained the buffer, so a 50k-member WHO
+ is produced a few KiB at a time instead of materializing megabytes at once.
+*/
+void Server::pumpReplyStreams(Client& client)
+{
+	while (client.hasReplyStream() && client.getOutBuf().size() < REPLY_HIGH_WATER)
+	{
+		if (!client.frontReplyStream().fill(client, REPLY_HIGH_WATER))
+			break;
+		client.popReplyStream();
 	}
-	return true;
 }
 
 const std::map<int, std::unique_ptr<Client>>& Server::getClients() const
@@ -440,9 +672,12 @@ void Server::sendData(int fd)
 	if (it == m_clients.end())
 		return;
 	Client &client = *(it->second);
+	// Broadcast log entries are copied in only as the socket drains
+	client.pullLogs(REPLY_HIGH_WATER);
 	if (!client.hasDataToSend())
 	{
 		disablePolloutForFd(fd);
+		client.parkOnLogs();
 		// Проверить, помечен ли клиент для отключения ПОСЛЕ отправки буфера
         if (client.shouldDisconnect())
         {
@@ -450,24 +685,50 @@ void Server::sendData(int fd)
         }
 		return;
 	}
-	const std::string &out = client.getOutBuf();
-
 	int flags = 0;
 
 	#ifdef MSG_NOSIGNAL
 		flags = MSG_NOSIGNAL;
 	#endif
-	ssize_t sent = send(fd, out.c_str(), out.size(), flags);
-	if (sent < 0)
-	{	
-		if (errno == EAGAIN || errno == EWOULDBLOCK)
+	// While the socket takes everything, keep refilling from the broadcast log:
+	// a reader that keeps up with a busy channel is not held to one refill per iteration
+	while (true)
+	{
+		const std::string &out = client.getOutBuf();
+		ssize_t sent = IRC_SEND(fd, out.c_str(), out.size(), flags);
+		if (sent < 0)
+		{	
+			// POLLOUT stays armed, so an interrupted send is simply retried next iteration
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return;
+			LOGE("send() failed on fd %d: %s", fd, std::strerror(errno));
+			disconnectClient(fd);
 			return;
-		std::cerr << "send() failed on fd " << fd << ": "
-				  << std::strerror(errno) << std::endl;
-		disconnectClient(fd);
-		return;
+		}
+		client.consumeOutBuf(static_cast<std::size_t>(sent));
+		IRC_PROBE3(send, fd, sent, client.getOutBuf().size());
+		// Record how long each fully sent block waited in m_outbuf
+		std::uint64_t now = Clock::nowMicros();
+		std::uint64_t enqueued_us;
+		while (client.popSentMark(enqueued_us))
+			m_outq_residence.record(now - enqueued_us);
+		if (!client.getOutBuf().empty() || !client.hasLogBacklog())
+			break;
+		client.pullLogs(REPLY_HIGH_WATER);
+		if (client.getOutBuf().empty())
+			break;
+	}
+	// Refill a streamed reply; once it is complete, read and dispatch again
+	if (client.hasReplyStream())
+	{
+		pumpReplyStreams(client);
+		if (!client.hasReplyStream())
+		{
+			if (!client.isPeerClosed())
+				enable_pollevent(m_poll_fds, fd, POLLIN);
+			processCommands(client);
+		}
 	}
-	client.consumeOutBuf(static_cast<std::size_t>(sent));
 	// If buffer is empty — stop watching POLLOUT
 	// if (!client.hasDataToSend())
 	// 	disablePolloutForFd(fd);
@@ -480,6 +741,7 @@ void Server::sendData(int fd)
     if (!client.hasDataToSend())
     {
         disablePolloutForFd(fd);
+        client.parkOnLogs();
         // Отключить клиента ПОСЛЕ отправки всех данных
         if (client.shouldDisconnect() || client.isPeerClosed())
         {
@@ -501,76 +763,336 @@ void Server::run()
 
     while (m_running) 
 	{
-        int poll_count = poll(&m_poll_fds[0], m_poll_fds.size(), -1);
-        
-        if (poll_count < 0) 
+		runOnce(-1);
+		// Shutdown runs here, between iterations, never inside the signal handler
+		if (m_stop_requested)
+			stop();
+	}
+}
+
+/*
+	One event-loop iteration: serve pending signal requests, poll() with timeout_ms
+	(-1 blocks; while shedding the wait is capped so recovery is noticed when idle),
+	then accept/send/receive/dispatch for every ready fd and clean up.
+	Returns the number of ready fds (0 on timeout or EINTR).
+*/
+int Server::runOnce(int timeout_ms)
+{
+	if (m_metrics_requested)
+	{
+		m_metrics_requested = 0;
+		// Format off-line and hand each line to the async logger
+		std::ostringstream snapshot;
+		dumpMetrics(snapshot);
+		std::istringstream lines(snapshot.str());
+		std::string line;
+		while (std::getline(lines, line))
+			Logger::log(Logger::Info, NULL, "%s", line.c_str());	// NULL site: never rate limited
+	}
+	if (m_trace_toggle_requested)
+	{
+		m_trace_toggle_requested = 0;
+		toggleTracing();
+	}
+	std::uint64_t iter_start = Clock::nowMicros();
+	int poll_count;
+	{
+		TraceSpan span("poll");
+		// While shedding, wake up periodically so recovery is noticed even when idle
+		if (m_shedding && (timeout_ms < 0 || timeout_ms > SHED_POLL_TIMEOUT_MS))
+			timeout_ms = SHED_POLL_TIMEOUT_MS;
+		poll_count = poll(m_poll_fds.data(), m_poll_fds.size(), timeout_ms);
+	}
+    
+    if (poll_count < 0) 
+	{
+        if (errno == EINTR) return 0;  // Signal interrupted
+        throw std::runtime_error("poll() failed");
+    }
+	TraceSpan iteration("iteration");
+	std::uint64_t poll_end = Clock::nowMicros();
+	m_tick.accept_us = 0;
+	m_tick.recv_us = 0;
+	m_tick.dispatch_us = 0;
+	m_tick.send_us = 0;
+    // Check all file descriptors POLLIN/OUT/ERR/HUP or revents - 0(client makes nothing)
+    for (size_t i = 0; i < m_poll_fds.size(); ++i) 
+	{
+        if (m_poll_fds[i].revents == 0)
+            continue;
+        // Listener socket - new connection
+        if (m_poll_fds[i].fd == m_listen_fd) 
 		{
-            if (errno == EINTR) continue;  // Signal interrupted
-            throw std::runtime_error("poll() failed");
+            if (m_poll_fds[i].revents & POLLIN) 
+			{
+				TraceSpan span("accept");
+				std::uint64_t start = Clock::nowMicros();
+                acceptClient();
+				m_tick.accept_us += Clock::nowMicros() - start;
+			}
         }
-        // Check all file descriptors POLLIN/OUT/ERR/HUP or revents - 0(client makes nothing)
-        for (size_t i = 0; i < m_poll_fds.size(); ++i) 
+        // Client socket - read/write
+        else 
 		{
-            if (m_poll_fds[i].revents == 0)
-                continue;
-            // Listener socket - new connection
-            if (m_poll_fds[i].fd == m_listen_fd) 
+			int client_fd = m_poll_fds[i].fd;
+            
+			// Ready to write (and has data to send)
+			if (m_poll_fds[i].revents & POLLOUT) 
 			{
-                if (m_poll_fds[i].revents & POLLIN) 
-                    acceptClient();
-            }
-            // Client socket - read/write
-            else 
+				// Also runs with an empty buffer: a broadcast log wakeup may have nothing
+				// left for this client, and sendData then drops POLLOUT again
+				TraceSpan span("send");
+				std::uint64_t start = Clock::nowMicros();
+				sendData(client_fd);
+				m_tick.send_us += Clock::nowMicros() - start;
+			}
+			/* sendData may have closed the connection: the next pollfd now sits in slot i */
+			if (m_clients.find(client_fd) == m_clients.end())
 			{
-				int client_fd = m_poll_fds[i].fd;
-                
-				// Ready to write (and has data to send)
-				if (m_poll_fds[i].revents & POLLOUT) 
-				{
-					Client* client = m_clients[client_fd].get();
-					if (!client->getOutBuf().empty())
-						sendData(client_fd);
-				}
-                // Check for errors/hangup
-                if (m_poll_fds[i].revents & (POLLERR | POLLNVAL)) 
-				{
-                    disconnectClient(client_fd);
-                    continue;
-                }
-				// POLLHUP — клиент закрыл соединение, но мы можем ещё отправить данные
-                if (m_poll_fds[i].revents & POLLHUP)
+				--i;
+				continue;
+			}
+            // Check for errors/hangup
+            if (m_poll_fds[i].revents & (POLLERR | POLLNVAL)) 
+			{
+                disconnectClient(client_fd);
+                --i;
+                continue;
+            }
+			// POLLHUP — клиент закрыл соединение, но мы можем ещё отправить данные
+            if (m_poll_fds[i].revents & POLLHUP)
+            {
+                auto it = m_clients.find(client_fd);
+                if (it != m_clients.end())
                 {
-                    auto it = m_clients.find(client_fd);
-                    if (it != m_clients.end())
-                    {
-                        Client& client = *(it->second);
-                        client.markPeerClosed();
-                        // Если есть данные для отправки — не отключать сразу
-                        if (!client.hasDataToSend())
-                        {
-                            disconnectClient(client_fd);
-                            continue;
-                        }
-                        // Иначе отключим после отправки в sendData
-                    }
-                    else
+                    Client& client = *(it->second);
+                    client.markPeerClosed();
+                    // Если есть данные для отправки — не отключать сразу
+                    if (!client.hasDataToSend())
                     {
+                        disconnectClient(client_fd);
+                        --i;
                         continue;
                     }
+                    // Иначе отключим после отправки в sendData
                 }
-                // Ready to read
-                if (m_poll_fds[i].revents & POLLIN) 
+                else
+                {
+                    continue;
+                }
+            }
+            // Ready to read
+            if (m_poll_fds[i].revents & POLLIN) 
+			{
+				std::uint64_t start = Clock::nowMicros();
+				std::uint64_t dispatch_before = m_tick.dispatch_us;
+				bool alive;
 				{
-                    if (!receiveData(client_fd)) 
-					{
-                        disconnectClient(client_fd);
-                        continue;
-                    }
+					TraceSpan span("recv");
+					alive = receiveData(client_fd);
+				}
+				// receive phase excludes the command dispatch done inside receiveData
+				m_tick.recv_us += (Clock::nowMicros() - start) - (m_tick.dispatch_us - dispatch_before);
+                if (!alive) 
+				{
+                    disconnectClient(client_fd);
+                    --i;
+                    continue;
                 }
             }
         }
-        cleanupDisconnectedClients();
     }
+	{
+		TraceSpan span("cleanup");
+		cleanupDisconnectedClients();
+	}
+
+	std::uint64_t iter_end = Clock::nowMicros();
+	m_phase_poll.record(poll_end - iter_start);
+	m_phase_accept.record(m_tick.accept_us);
+	m_phase_recv.record(m_tick.recv_us);
+	m_phase_dispatch.record(m_tick.dispatch_us);
+	m_phase_send.record(m_tick.send_us);
+	m_loop_busy.record(iter_end - poll_end);
+	updateLoadState(poll_end, iter_end - poll_end, iter_end);
+	return poll_count;
+}
+
+/*
+	Lag monitor, called once per loop iteration with the busy (non-poll) time.
+	Busy time is summed over windows of LAG_WINDOW_US wall time; at the end of each
+	window the busy fraction decides the state, so a single idle wakeup or a single
+	slow iteration no longer flips it.
+	- Enter shedding when a window was at least SHED_ENTER_PERMILLE busy
+	- Leave shedding when a window was under SHED_LEAVE_PERMILLE busy
+	  (hysteresis, so the server does not flap around one threshold)
+*/
+void Server::updateLoadState(std::uint64_t iter_start, std::uint64_t busy_us, std::uint64_t now)
+{
+	if (m_window_start == 0)
+		m_window_start = iter_start;
+	m_window_busy_us += busy_us;
+	std::uint64_t elapsed = now - m_window_start;
+	if (elapsed < LAG_WINDOW_US)
+		return;
+	m_busy_permille = m_window_busy_us * 1000 / elapsed;
+	m_window_start = now;
+	m_window_busy_us = 0;
+	if (!m_shedding && m_busy_permille >= SHED_ENTER_PERMILLE)
+		enterShedding(now);
+	else if (m_shedding && m_busy_permille < SHED_LEAVE_PERMILLE)
+		leaveShedding(now);
+}
+
+/*
+	Shedding mode:
+	- stop accepting: drop POLLIN interest on the listener, pending connections wait in the backlog
+	- CommandHandler defers WHO/NAMES/LIST (see isShedding())
+	- receiveData uses SHED_READ_BUDGET instead of READ_BUDGET
+*/
+void Server::enterShedding(std::uint64_t now)
+{
+	m_shedding = true;
+	m_shed_since = now;
+	++m_shed_enter_count;
+	disable_pollevent(m_poll_fds, m_listen_fd, POLLIN);
+	LOGW("Event loop lagging (p99 busy %llu us): entering load shedding mode",
+		 static_cast<unsigned long long>(m_loop_busy.percentile(0.99)));
+}
+
+// Restore listener interest and run the commands that were deferred while shedding.
+void Server::leaveShedding(std::uint64_t now)
+{
+	m_shedding = false;
+	m_shed_total_us += now - m_shed_since;
+	for (size_t i = 0; i < m_poll_fds.size(); ++i)
+	{
+		if (m_poll_fds[i].fd == m_listen_fd)
+			m_poll_fds[i].events = m_poll_fds[i].events | POLLIN;
+	}
+	LOGW("Event loop recovered after %llu ms: leaving load shedding mode",
+		 static_cast<unsigned long long>((now - m_shed_since) / 1000));
+	replayDeferredCommands();
+}
+
+/*
+	Deferred commands are replayed in arrival order per client, followed by whatever
+	the client sent after them (processCommands), and reading resumes.
+	Clients already marked for disconnect are skipped: nothing may follow their ERROR line.
+	Handlers never erase clients (disconnection is deferred to cleanupDisconnectedClients),
+	so iterating m_clients here is safe.
+*/
+void Server::replayDeferredCommands()
+{
+	for (std::map<int, std::unique_ptr<Client>>::iterator it = m_clients.begin();
+		 it != m_clients.end(); ++it)
+	{
+		Client& client = *(it->second);
+		if (client.getDeferredCount() == 0 || client.shouldDisconnect())
+			continue;
+		if (!client.isPeerClosed())
+			enable_pollevent(m_poll_fds, it->first, POLLIN);
+		processCommands(client);
+		if (client.hasDataToSend())
+			enablePolloutForFD(it->first);
+	}
+}
+
+bool Server::isShedding() const{return m_shedding;}
+
+// Called from the SIGUSR2 handler: run() starts or stops the trace session on its next iteration.
+void Server::requestTraceToggle(){m_trace_toggle_requested = 1;}
+
+/*
+	First toggle starts recording loop phase and command spans,
+	the second one stops and writes them as Chrome trace-event JSON in the working directory.
+*/
+void Server::toggleTracing()
+{
+	if (!Tracer::isRecording())
+	{
+		Tracer::start();
+		LOGI("Tracing started (send SIGUSR2 again to stop and dump)");
+		return;
+	}
+	Tracer::stop();
+	std::string path = Tracer::dump();
+	if (path.empty())
+		LOGE("Tracing stopped, failed to write trace file");
+	else
+		LOGI("Tracing stopped, trace written to %s", path.c_str());
+}
+
+
+/*
+	Called from the SIGUSR1 handler: only sets a flag, run() prints the snapshot
+	at the top of the next iteration (poll() returns EINTR, so that is immediate).
+*/
+void Server::requestMetricsDump(){m_metrics_requested = 1;}
+
+// Called from the SIGINT/SIGTERM handler: run() shuts down once the current iteration is done.
+void Server::requestStop(){m_stop_requested = 1;}
+
+/*
+	Print a metrics snapshot:
+	- outq_residence_us: time output blocks spent in m_outbuf before send() took them
+	- outq_oldest_pending_us: age of the oldest unsent byte over all clients (head-of-line blocking),
+	  a large value with a healthy residence histogram points at one slow client, not a slow server
+*/
+void Server::dumpMetrics(std::ostream& os) const
+{
+	std::uint64_t now = Clock::nowMicros();
+	std::uint64_t oldest_age = 0;
+	int oldest_fd = -1;
+	std::size_t pending_clients = 0;
+	std::uint64_t pending_bytes = 0;
+	for (std::map<int, std::unique_ptr<Client>>::const_iterator it = m_clients.begin();
+		 it != m_clients.end(); ++it)
+	{
+		if (!it->second->hasDataToSend())
+			continue;
+		++pending_clients;
+		pending_bytes += it->second->getOutBuf().size();
+		std::uint64_t stamp = it->second->getOldestPendingStamp();
+		if (stamp != 0 && now - stamp >= oldest_age)
+		{
+			oldest_age = now - stamp;
+			oldest_fd = it->first;
+		}
+	}
+	os << "# ircserv metrics\n";
+	os << "clients=" << m_clients.size() << " channels=" << m_channels.size() << "\n";
+	m_outq_residence.print(os, "outq_residence_us");
+	os << "outq_pending clients=" << pending_clients << " bytes=" << pending_bytes << "\n";
+	os << "outq_oldest_pending_us age=" << oldest_age << " fd=" << oldest_fd << "\n";
+	m_phase_poll.print(os, "loop_poll_us");
+	m_phase_accept.print(os, "loop_accept_us");
+	m_phase_recv.print(os, "loop_recv_us");
+	m_phase_dispatch.print(os, "loop_dispatch_us");
+	m_phase_send.print(os, "loop_send_us");
+	m_loop_busy.print(os, "loop_busy_us");
+	std::uint64_t shed_total = m_shed_total_us + (m_shedding ? now - m_shed_since : 0);
+	os << "load_shedding active=" << (m_shedding ? 1 : 0)
+	   << " busy_permille=" << m_busy_permille
+	   << " entered=" << m_shed_enter_count
+	   << " total_us=" << shed_total
+	   << " deferred=" << m_cmd_handler->getDeferredCount() << "\n";
+	std::size_t log_channels = 0;
+	for (std::map<std::string, std::unique_ptr<Channel>>::const_iterator it = m_channels.begin();
+		 it != m_channels.end(); ++it)
+	{
+		if (it->second->hasBroadcastLog())
+			++log_channels;
+	}
+	os << "broadcast_log channels=" << log_channels
+	   << " min_members=" << m_log_min_members
+	   << " policy=" << (m_lag_disconnect ? "disconnect" : "drop")
+	   << " dropped=" << m_log_dropped
+	   << " lag_disconnects=" << m_lag_disconnects << "\n";
+	os << "logger dropped=" << Logger::getDroppedCount()
+	   << " suppressed=" << Logger::getSuppressedCount() << "\n";
+	if (FaultInjection::isEnabled())
+		FaultInjection::print(os);
 }
 
 //  Method for graceful shutdown
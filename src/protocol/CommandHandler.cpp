@@ -8,7 +8,45 @@
 
 #include "protocol/CommandHandler.hpp"
 #include "protocol/Replies.hpp"
+#include "protocol/ReplyStream.hpp"
 #include "network/Server.hpp"
+#include "utils/Logger.hpp"
+#include "utils/Metrics.hpp"
+#include "utils/Probes.hpp"
+#include "utils/Tracer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+
+// RFC 1459 line limit including \r\n
+static const std::size_t	MAX_MESSAGE_LENGTH = 512;
+
+// IRCv3 capabilities offered by CAP LS: wire name, bit in Client's set, value shown to CAP 302 clients
+struct CapabilityInfo {
+	const char*	name;
+	Capability	cap;
+	const char*	value;
+};
+static const CapabilityInfo	CAPABILITIES[] = {
+	{"echo-message", CAP_ECHO_MESSAGE, ""},
+	{"message-tags", CAP_MESSAGE_TAGS, ""},
+	{"server-time", CAP_SERVER_TIME, ""},
+	{"batch", CAP_BATCH, ""},
+	{"draft/no-implicit-names", CAP_NO_IMPLICIT_NAMES, ""},
+};
+static const std::size_t	CAPABILITY_COUNT = sizeof(CAPABILITIES) / sizeof(CAPABILITIES[0]);
+
+static const CapabilityInfo* findCapability(const std::string& name) {
+	for (std::size_t i = 0; i < CAPABILITY_COUNT; ++i) {
+		if (name == CAPABILITIES[i].name)
+			return &CAPABILITIES[i];
+	}
+	return NULL;
+}
+
+// Most messages a single CHATHISTORY request returns
+static const std::size_t	CHATHISTORY_MAX_LIMIT = 100;
 
 /**
  * @brief Constructor initializes the command handler with server reference
@@ -18,7 +56,10 @@
  * @param password Server password that clients mut provide
  */
 CommandHandler::CommandHandler(Server& server, const std::string& password)
-	: m_server(server), m_password(password), m_server_name("ircserv")
+	: m_server(server), m_password(password), m_server_name("ircserv"),
+	  m_deferred_count(0), m_fanout(0), m_next_msgid(1), m_log_wakeups(),
+	  m_relay_marks(), m_relay_round(0), m_direct_entry(), m_held_pollout_fd(-1),
+	  m_next_batch(1)
 {
 }
 
@@ -65,22 +106,9 @@ bool CommandHandler::isValidNickname(const std::string& nickname) {
  * @return true if nickname is taken, false if available
  */
 bool CommandHandler::isNicknameInUse(const std::string& nickname, int exclude_fd) {
-	// Get reference to server's client map
-	const std::map<int, std::unique_ptr<Client>>& clients = m_server.getClients();
-
-	// Iterate through all connected clients
-	for (std::map<int, std::unique_ptr<Client>>::const_iterator it = clients.begin();
-		it != clients.end(); ++it)
-	{
-		// Skip the client we want to exclude (typically the one changing nick)
-		if (it->first == exclude_fd)
-			continue;
-
-		// Check if this client has the nickname
-		if (it->second->getNickname() == nickname)
-			return true;
-	}
-	return false;
+	// Nickname index lookup; the excluded client (typically the one changing nick) does not count
+	Client* owner = m_server.findClientByNickname(nickname);
+	return owner && owner->getFD() != exclude_fd;
 }
 
 /**
@@ -118,6 +146,32 @@ bool CommandHandler::isValidChannelName(const std::string& name) {
 	return true;
 }
 
+/**
+ * @brief Check if a command produces replies proportional to channel/server size.
+ * These are postponed while the server is in load shedding mode.
+ * 
+ * @param command Upper-case command name
+ * @return True for WHO, NAMES, LIST and CHATHISTORY
+ */
+bool CommandHandler::isExpensiveCommand(const std::string& command) const {
+	return command == "WHO" || command == "NAMES" || command == "LIST" || command == "CHATHISTORY";
+}
+
+/**
+ * @brief Complete registration once PASS, NICK and USER are in
+ * A client that started CAP negotiation before registering is held until CAP END.
+ * @param client Client to check
+ */
+void CommandHandler::tryRegister(Client& client) {
+	// Registration requires: authenticated + nickname + username (+ CAP END if negotiating)
+	if (!client.isRegistered() && client.isAuthenticated() && !client.isCapNegotiating() &&
+		!client.getNickname().empty() && !client.getUsername().empty())
+	{
+		client.setRegistered(true);
+		sendWelcome(client);
+	}
+}
+
 /**
  * @brief Send welcome messages (RPL_WELCOME through RPL_MYINFO) to client.
  * Called after successful registration (PASS + NICK + USER complete)
@@ -142,7 +196,15 @@ void CommandHandler::sendWelcome(Client& client) {
 	// RPL_MYINFO (004): Server name, version, and available modes
 	// Format: <servername> <version> <user modes> <channel modes>
 	sendNumeric(client, RPL_MYINFO,
-		m_server_name + " 1.0 io itkol");
+		m_server_name + " 1.0 io itkolu");
+
+	// RPL_ISUPPORT (005): limits and syntax clients should know about
+	// The tokens are middle parameters, so the line is built here rather than by sendNumeric
+	std::string max_targets = std::to_string(m_server.getMaxTargets());
+	sendReply(client, ":" + m_server_name + " 005 " + client.getNickname() +
+		" CHANTYPES=#& PREFIX=(o)@ CHANMODES=,k,l,itu NICKLEN=9 CHANNELLEN=50"
+		" MAXTARGETS=" + max_targets + " TARGMAX=PRIVMSG:" + max_targets + ",NOTICE:" + max_targets +
+		" CHATHISTORY=" + std::to_string(CHATHISTORY_MAX_LIMIT) + " :are supported by this server\r\n");
 }
 
 /**
@@ -154,7 +216,46 @@ void CommandHandler::sendWelcome(Client& client) {
  */
 void CommandHandler::sendReply(Client& client, const std::string& reply) {
 	client.appendToOutBuf(reply);
-	m_server.enablePolloutForFD(client.getFD());
+	++m_fanout;
+	if (client.getFD() != m_held_pollout_fd)
+		m_server.enablePolloutForFD(client.getFD());
+}
+
+/**
+ * @brief Send a recorded message (history entry or tagged direct message) to a client
+ * The client gets the tag variant it negotiated, sliced from the stored line.
+ */
+void CommandHandler::sendEntry(Client& client, const HistoryEntry& entry, const std::string& batch_tag) {
+	client.appendEntry(entry, batch_tag);
+	++m_fanout;
+	if (client.getFD() != m_held_pollout_fd)
+		m_server.enablePolloutForFD(client.getFD());
+}
+
+/**
+ * @brief Reference for a new BATCH sent to client
+ * @return A server-wide unique reference, or "" when the client did not enable batch
+ */
+std::string CommandHandler::newBatchRef(Client& client) {
+	if (!client.hasCap(CAP_BATCH))
+		return "";
+	return std::to_string(m_next_batch++);
+}
+
+/**
+ * @brief Start a multi-channel command (JOIN/PART lists) for client
+ * Until releasePollout, replies to client only go to its output buffer: enablePolloutForFD
+ * scans the poll set, and one update at the end covers the whole list.
+ */
+void CommandHandler::holdPollout(Client& client) {
+	m_held_pollout_fd = client.getFD();
+}
+
+// Enable POLLOUT once for everything queued since holdPollout
+void CommandHandler::releasePollout(Client& client) {
+	m_held_pollout_fd = -1;
+	if (client.hasDataToSend())
+		m_server.enablePolloutForFD(client.getFD());
 }
 
 /**
@@ -185,6 +286,50 @@ void CommandHandler::sendNumeric(Client& client, int numeric_code, const std::st
 	sendReply(client, reply);
 }
 
+/**
+ * @brief Send an IRCv3 standard FAIL reply
+ * Format: :server FAIL <command> <code> [<context>] :<message>
+ * @param client Target client
+ * @param command Command that failed
+ * @param code Machine-readable reason (INVALID_PARAMS, INVALID_TARGET, ...)
+ * @param context Extra parameters (may be empty)
+ * @param message Human-readable description
+ */
+void CommandHandler::sendFail(Client& client, const std::string& command, const std::string& code, const std::string& context, const std::string& message) {
+	std::vector<std::string> params;
+	params.push_back(command);
+	params.push_back(code);
+	if (!context.empty())
+		params.push_back(context);
+	sendReply(client, MessageBuilder::buildCommandMessage(m_server_name, "FAIL", params, message));
+}
+
+/**
+ * @brief Broadcast a membership change (JOIN, PART, QUIT, NICK) of `actor`.
+ * In auditorium channels (+u) a non-operator's change only reaches the operators
+ * and the actor itself, so filling a big channel costs O(ops) per join instead of O(members).
+ * @param channel Channel the change happens in
+ * @param actor Member joining, leaving or renaming
+ * @param message Formatted IRC message (must end with \r\n)
+ * @param exclude_fd Optional file descriptor to exclude (e.g., the actor for NICK)
+ */
+void CommandHandler::broadcastMembership(Channel& channel, Client& actor, const std::string& message, int exclude_fd) {
+	if (!channel.isAuditorium() || channel.isOperator(actor.getFD())) {
+		broadcastToChannel(channel, message, exclude_fd);
+		return;
+	}
+	const std::map<int, Client*>& members = channel.getMembers();
+	const std::set<int>& ops = channel.getOperators();
+	for (std::set<int>::const_iterator it = ops.begin(); it != ops.end(); ++it) {
+		std::map<int, Client*>::const_iterator member = members.find(*it);
+		if (*it == exclude_fd || member == members.end())
+			continue;
+		sendReply(*member->second, message);
+	}
+	if (actor.getFD() != exclude_fd)
+		sendReply(actor, message);
+}
+
 /**
  * @brief Broadcast a message to a channel and enable POLLOUT for recipients.
  * @param channel Target channel
@@ -193,14 +338,62 @@ void CommandHandler::sendNumeric(Client& client, int numeric_code, const std::st
  */
 void CommandHandler::broadcastToChannel(Channel& channel, const std::string& message, int exclude_fd) {
 	channel.broadcast(message, exclude_fd);
+	wakeMembers(channel, exclude_fd);
+}
+
+// Enable POLLOUT for every member but exclude_fd after a broadcast
+void CommandHandler::wakeMembers(Channel& channel, int exclude_fd) {
 	const std::map<int, Client*>& members = channel.getMembers();
 	for (std::map<int, Client*>::const_iterator it = members.begin(); it != members.end(); ++it) {
 		if (it->first == exclude_fd)
 			continue;
-		m_server.enablePolloutForFD(it->first);
+		if (it->first != m_held_pollout_fd)
+			m_server.enablePolloutForFD(it->first);
+		++m_fanout;
 	}
 }
 
+/**
+ * @brief Record a channel message (PRIVMSG, NOTICE, TOPIC) in the channel history, then broadcast it.
+ * The broadcast uses the stored entry, so history costs one copy and no extra serialization;
+ * its msgid and time tags are serialized once and each member gets the slice it negotiated.
+ * In a channel using the broadcast log, recording is the whole fan-out: members copy the
+ * line when their socket drains, and only members that were idle are woken (POLLOUT),
+ * so a busy channel costs O(1) per message whatever its size.
+ * @param channel Target channel
+ * @param message Formatted IRC message (must end with \r\n)
+ * @param exclude_fd Optional file descriptor to exclude from receiving the message (e.g., sender)
+ * @return The recorded entry (valid until the channel records its next message)
+ */
+const HistoryEntry& CommandHandler::broadcastWithHistory(Channel& channel, const std::string& message, int exclude_fd) {
+	const HistoryEntry& entry = channel.recordHistory(m_next_msgid++, Clock::wallMillis(), message, exclude_fd);
+	if (!channel.hasBroadcastLog()) {
+		channel.broadcastEntry(entry, exclude_fd);
+		wakeMembers(channel, exclude_fd);
+		return entry;
+	}
+	channel.takeLogWaiters(m_log_wakeups);
+	for (std::set<int>::const_iterator it = m_log_wakeups.begin(); it != m_log_wakeups.end(); ++it) {
+		m_server.enablePolloutForFD(*it);
+		++m_fanout;
+	}
+	return entry;
+}
+
+/**
+ * @brief Tag a private message (msgid, time) so it is delivered like a channel one
+ * @param line Serialized message including \r\n
+ * @return Scratch entry, valid until the next call
+ */
+const HistoryEntry& CommandHandler::tagDirectMessage(const std::string& line) {
+	m_direct_entry.msgid = m_next_msgid++;
+	m_direct_entry.time_ms = Clock::wallMillis();
+	m_direct_entry.exclude_fd = -1;
+	m_direct_entry.tags_size = MessageBuilder::buildTaggedLine(m_direct_entry.line, m_direct_entry.msgid,
+		m_direct_entry.time_ms, line, m_direct_entry.time_pos);
+	return m_direct_entry;
+}
+
 /**
  * @brief Handle PASS command - authenticate client with server password.
  * Format: PASS <password>
@@ -229,14 +422,7 @@ void CommandHandler::handlePass(Client& client, const Message& msg) {
 		// std::cout << "Client fd " << client.getFD() << " authenticated successfully\n";
 
 		// Check if client can now be registered
-		// Registration requires: authenticated + nickname + username
-		if (!client.isRegistered() && client.isAuthenticated() &&
-			!client.getNickname().empty() && !client.getUsername().empty()) 
-		{
-			client.setRegistered(true);
-			sendWelcome(client);
-			// std::cout << "Client fd " << client.getFD() << " is now fully registered\n";
-		}
+		tryRegister(client);
 	}
 	else
 	{
@@ -276,8 +462,8 @@ void CommandHandler::handleNick(Client& client, const Message& msg) {
 	// Store old nickname for notification (if changing nick)
 	std::string old_nick = client.getNickname();
 
-	// Set the new nickname
-	client.setNickname(new_nick);
+	// Set the new nickname (and move it in the server's nickname index)
+	m_server.updateNickname(client, new_nick);
 	// std::cout << "Client fd " << client.getFD() << " nickname set to: " << new_nick << "\n";
 
 	// If client is already registered, notify about nick change
@@ -294,22 +480,16 @@ void CommandHandler::handleNick(Client& client, const Message& msg) {
 			Channel* chan = it->second.get();
 			if (chan && chan->isMember(client.getFD()))
 			{
+				chan->renameMember(client.getFD(), old_nick);
 				// exclude sender
-				broadcastToChannel(*chan, nick_change, client.getFD());
+				broadcastMembership(*chan, client, nick_change, client.getFD());
 			}
 		}
 		// std::cout << "Nick change broadcast: " << old_nick << " -> " << new_nick << "\n";
 	}
 	
 	// Check if client can now be registered
-	// Registration requires: authenticated + nickname + username
-	if (!client.isRegistered() && client.isAuthenticated() &&
-		!client.getNickname().empty() && !client.getUsername().empty()) 
-	{
-		client.setRegistered(true);
-		sendWelcome(client);
-		// std::cout << "Client fd " << client.getFD() << " is now fully registered\n";
-	}
+	tryRegister(client);
 }
 
 /**
@@ -344,14 +524,7 @@ void CommandHandler::handleUser(Client& client, const Message& msg) {
 				// << ", realname: " << msg.trailing << "\n";
 
 	// Check if client can now be registered
-	// Registration requires: authenticated + nickname + username
-	if (!client.isRegistered() && client.isAuthenticated() &&
-		!client.getNickname().empty() && !client.getUsername().empty())
-	{
-		client.setRegistered(true);
-		sendWelcome(client);
-		// std::cout << "Client fd " << client.getFD() << " is now fully registered\n";
-	}
+	tryRegister(client);
 }
 
 /**
@@ -392,18 +565,13 @@ void CommandHandler::handlePing(Client& client, const Message& msg)
 }
 
 /**
- * @brief Handle QUIT command - disconnect cliet from server.
- * Format: QUIT [:<reason>]
- * @param client Client issuing the QUIT command
- * @param msg Parsed IRC message containing optional quit reason (trailing)
+ * @brief Broadcast QUIT to all channels the client is on, remove it from them
+ * and delete channels left empty.
+ * @param client Client leaving the server
+ * @param reason Quit reason sent to the other members
  */
-void CommandHandler::handleQuit(Client& client, const Message& msg)
+void CommandHandler::quitChannels(Client& client, const std::string& reason)
 {
-	// Extract quit reason (optional)
-	std::string reason = msg.trailing.empty() ? "Client exited" : msg.trailing;
-
-	// std::cout << "Client fd " << client.getFD() << " quit: " << reason << "\n";
-
 	// Build QUIT message to broadcast to channels
 	// Format: :nick!user@host QUIT :reason
 	std::string quit_msg;
@@ -427,7 +595,7 @@ void CommandHandler::handleQuit(Client& client, const Message& msg)
 			Channel* chan = it->second.get();
 			if (chan && chan->isMember(client.getFD())) {
 				// Broadcast QUIT to all members of this channel
-				broadcastToChannel(*chan, quit_msg);
+				broadcastMembership(*chan, client, quit_msg);
 				// Remove client from channel
 				chan->removeMember(client.getFD());
 
@@ -443,7 +611,35 @@ void CommandHandler::handleQuit(Client& client, const Message& msg)
 			// std::cout << "Channel " << channels_to_remove[i] << " removed (empty after QUIT)\n";
 		}
 	}
-	
+}
+
+/**
+ * @brief Clean up after a connection that went away without QUIT
+ * (EOF, reset, read/write error, overflow). Called by Server right before
+ * the Client is destroyed so no channel keeps a dangling Client pointer.
+ * @param client Client being disconnected
+ */
+void CommandHandler::handleConnectionLost(Client& client)
+{
+	quitChannels(client, client.getQuitReason().empty() ? "Connection closed" : client.getQuitReason());
+}
+
+/**
+ * @brief Handle QUIT command - disconnect cliet from server.
+ * Format: QUIT [:<reason>]
+ * @param client Client issuing the QUIT command
+ * @param msg Parsed IRC message containing optional quit reason (trailing)
+ */
+void CommandHandler::handleQuit(Client& client, const Message& msg)
+{
+	// Extract quit reason (optional)
+	std::string reason = msg.trailing.empty() ? "Client exited" : msg.trailing;
+
+	// std::cout << "Client fd " << client.getFD() << " quit: " << reason << "\n";
+
+	// Broadcast QUIT to every channel the client is on and leave them
+	quitChannels(client, reason);
+
 	// send ERROR message to client before quit (based on RFC)
     std::string error_msg = "ERROR :Closing Link: " + client.getNickname() + 
                             " (Quit: " + reason + ")\r\n";
@@ -456,7 +652,7 @@ void CommandHandler::handleQuit(Client& client, const Message& msg)
 
 /**
  * @brief Handle PRIVMSG command - send private message to user or channel.
- * Format: PRIVMSG <target> :<message>
+ * Format: PRIVMSG <target>{,<target>} :<message>
  * @param client Client issuing the PRIVMSG command
  * @param msg Parsed IRC message containing target and message text
  */
@@ -482,92 +678,13 @@ void CommandHandler::handlePrivmsg(Client& client, const Message& msg)
 		return;
 	}
 
-	std::string target = msg.params[0];
-	std::string message = msg.trailing;
-
-	// Check if target is a channel (starts with #)
-	if (!target.empty() && target[0] == '#')
-	{
-		// Find channel
-		Channel* chan = m_server.findChannel(target);
-
-		if (!chan)
-		{
-			// Channel doesn't exist
-			sendError(client, ERR_NOSUCHCHANNEL, target, "No such channel");
-			return;
-		}
-
-		// Check if sender is a member of the channel
-		if (!chan->isMember(client.getFD()))
-		{
-			sendError(client, ERR_CANNOTSENDTOCHAN, target, "Cannot send to channel");
-			return;
-		}
-
-		// Build PRIVMSG for channel
-		// Format: :sender!user@host PRIVMSG #channel :message
-		std::string prefix = client.getNickname() + "!" +
-							client.getUsername() + "@localhost";
-		std::vector<std::string> params;
-		params.push_back(target);
-
-		std::string privmsg = MessageBuilder::buildCommandMessage(
-			prefix, "PRIVMSG", params, message
-		);
-
-		// Broadcast to all channel memers except sender
-		broadcastToChannel(*chan, privmsg, client.getFD());
-
-		// std::cout << "PRIVMSG from " << client.getNickname()
-		// 			<< " to channel " << target << ": " << message << "\n";
-	} 
-	else
-	{
-		// Target is a user nickname - find the user
-		const std::map<int, std::unique_ptr<Client>>& clients = m_server.getClients();
-		Client* target_client = nullptr;
-
-		for (std::map<int, std::unique_ptr<Client>>::const_iterator it = clients.begin();
-			it != clients.end(); ++it)
-		{
-			if (it->second->getNickname() == target)
-			{
-				target_client = it->second.get();
-				break;
-			}
-		}
-
-		// Check if target user exists
-		if (!target_client)
-		{
-			sendError(client, ERR_NOSUCHNICK, target, "No such nick/channel");
-			return;
-		}
-
-		// Build PRIVMSG with sender prefix
-		// Format: :sender!user@host PRIVMSG target :message
-		std::string prefix = client.getNickname() + "!" +
-							client.getUsername() + "@localhost";
-		
-		std::vector<std::string> params;
-		params.push_back(target);
-
-		std::string privmsg = MessageBuilder::buildCommandMessage(
-			prefix, "PRIVMSG", params, message
-		);
-
-		// Send to target user
-		sendReply(*target_client, privmsg);
-
-		// std::cout << "PRIVMSG from " << client.getNickname()
-		// 			<< " to " << target << ": " << message << "\n";
-	}
+	// Comma-separated targets, each one a channel or a nickname
+	relayMessage(client, "PRIVMSG", msg.params[0], msg.trailing, true);
 }
 
 /**
  * @brief Handle NOTICE command - send notice to user or channel.
- * Format: NOTICE <target> :<message>
+ * Format: NOTICE <target>{,<target>} :<message>
  * @param client Client issuing the NOTICE command
  * @param msg Parsed IRC message containing target and message text
  * 
@@ -596,92 +713,214 @@ void CommandHandler::handleNotice(Client& client, const Message& msg) {
 		return;
 	}
 
-	std::string target = msg.params[0];
-	std::string message = msg.trailing;
-
-	// Check if target is a channel (starts with #)
-	if (!target.empty() && target[0] == '#')
-	{
-		// Find channel
-		Channel* chan = m_server.findChannel(target);
-
-		if (!chan)
-		{
-			// No error for NOTICE (per RFC)
-			return;
-		}
+	// Comma-separated targets, each one a channel or a nickname
+	relayMessage(client, "NOTICE", msg.params[0], msg.trailing, false);
+}
 
-		// Check if sender is a member of the channel
-		if (!chan->isMember(client.getFD()))
-		{
-			// No error for NOTICE (per RFC)
-			return;
+// Split a comma-separated parameter (JOIN/PART channels and keys, message targets); empty items are kept
+static std::vector<std::string> splitList(const std::string& list) {
+	std::vector<std::string> items;
+	std::size_t start = 0;
+	while (true) {
+		std::size_t comma = list.find(',', start);
+		if (comma == std::string::npos) {
+			items.push_back(list.substr(start));
+			return items;
 		}
+		items.push_back(list.substr(start, comma - start));
+		start = comma + 1;
+	}
+}
 
-		// Build NOTICE for channel
-		// Format: :sender!user@host NOTICE #channel :message
-		std::string prefix = client.getNickname() + "!" +
-							client.getUsername() + "@localhost";
-		std::vector<std::string> params;
-		params.push_back(target);
+// Channel names start with one of CHANTYPES (#&)
+static bool isChannelName(const std::string& name) {
+	return !name.empty() && (name[0] == '#' || name[0] == '&');
+}
 
-		std::string notice = MessageBuilder::buildCommandMessage(
-			prefix, "NOTICE", params, message
-		);
+/*
+ One relayed line, built in a single allocation.
+ Format: :sender!user@host <command> <target> :<text>
+*/
+static std::string relayLine(const Client& sender, const std::string& command, const std::string& target,
+	const std::string& text) {
+	std::string line;
+	line.reserve(sender.getNickname().size() + sender.getUsername().size() + command.size() +
+		target.size() + text.size() + 18);
+	line += ':';
+	line += sender.getNickname();
+	line += '!';
+	line += sender.getUsername();
+	line += "@localhost ";
+	line += command;
+	line += ' ';
+	line += target;
+	line += " :";
+	line += text;
+	line += "\r\n";
+	if (line.size() > MAX_MESSAGE_LENGTH)
+		throw std::length_error("IRC message exceeds maximum length of 512 characters");
+	return line;
+}
 
-		// Broadcast to all channel members except sender
-		broadcastToChannel(*chan, notice, client.getFD());
+/**
+ * @brief Deliver a PRIVMSG/NOTICE to a comma-separated list of channels and nicknames
+ * @param client Sender
+ * @param command "PRIVMSG" or "NOTICE"
+ * @param targets Target list (at most MAXTARGETS entries; repeated targets count once)
+ * @param text Message text
+ * @param send_errors False for NOTICE (no automatic replies, per RFC)
+ * 
+ * Targets are resolved and every line is built before anything is delivered,
+ * so errors come back in list order and an oversized line delivers nothing.
+ * With several targets, a recipient reached through more than one of them gets
+ * a single copy (claimRecipient). Channels using the broadcast log go first,
+ * because their members read the log and cannot be filtered; later targets
+ * skip those members. Members of two targeted broadcast-log channels still get
+ * one copy per channel.
+ * Senders with echo-message get their own copy of each delivered target, with the
+ * same msgid. Private messages are tagged too (tagDirectMessage).
+ */
+void CommandHandler::relayMessage(Client& client, const std::string& command, const std::string& targets,
+	const std::string& text, bool send_errors) {
+	// Common case, one target: nothing to split or deduplicate
+	if (targets.find(',') == std::string::npos) {
+		Channel* chan = NULL;
+		Client* target = NULL;
+		if (isChannelName(targets))
+			chan = resolveRelayChannel(client, targets, send_errors);
+		else {
+			target = m_server.findClientByNickname(targets);
+			if (!target && send_errors)
+				sendError(client, ERR_NOSUCHNICK, targets, "No such nick/channel");
+		}
+		if (!chan && !target)
+			return;
+		std::string line = relayLine(client, command, targets, text);
+		const HistoryEntry& entry = chan ? broadcastWithHistory(*chan, line, client.getFD()) : tagDirectMessage(line);
+		if (target)
+			sendEntry(*target, entry);
+		if (client.hasCap(CAP_ECHO_MESSAGE))
+			sendEntry(client, entry);
+		return;
+	}
 
-		// std::cout << "NOTICE from " << client.getNickname()
-		// 			<< " to channel " << target << ": " << message << "\n";
+	// Split the list, dropping empty and repeated entries
+	std::vector<std::string> items = splitList(targets);
+	std::vector<std::string> names;
+	for (std::size_t i = 0; i < items.size(); ++i) {
+		if (!items[i].empty() && std::find(names.begin(), names.end(), items[i]) == names.end())
+			names.push_back(items[i]);
+	}
+	if (names.empty()) {
+		if (send_errors)
+			sendError(client, ERR_NORECIPIENT, "", "No recipient given (" + command + ")");
+		return;
+	}
+	if (names.size() > m_server.getMaxTargets()) {
+		if (send_errors)
+			sendError(client, ERR_TOOMANYTARGETS, names[m_server.getMaxTargets()], "Too many recipients. Message not delivered");
+		return;
 	}
-	else
-	{
-		// Target is a user nickname - find the user
-		const std::map<int, std::unique_ptr<Client>>& clients = m_server.getClients();
-		Client* target_client = nullptr;
 
-		for (std::map<int, std::unique_ptr<Client>>::const_iterator it = clients.begin();
-            it != clients.end(); ++it)
-		{
-			if (it->second->getNickname() == target)
-			{
-				target_client = it->second.get();
-				break;
-			}
-		}
+	std::vector<std::string> lines;
+	for (std::size_t i = 0; i < names.size(); ++i)
+		lines.push_back(relayLine(client, command, names[i], text));
 
-		// Check if targte user exists
-		if (!target_client)
-		{
-			// No error for NOTICE (per RFC)
-			return;
+	std::vector<Channel*> channels(names.size(), nullptr);
+	std::vector<Client*> users(names.size(), nullptr);
+	for (std::size_t i = 0; i < names.size(); ++i) {
+		if (isChannelName(names[i]))
+			channels[i] = resolveRelayChannel(client, names[i], send_errors);
+		else {
+			users[i] = m_server.findClientByNickname(names[i]);
+			if (!users[i] && send_errors)
+				sendError(client, ERR_NOSUCHNICK, names[i], "No such nick/channel");
 		}
+	}
 
-		// Build NOTICE with sender prefix
-		// Format: :sender!user@host NOTICE target :message
-		std::string prefix = client.getNickname() + "!" +
-							client.getUsername() + "@localhost";
-		std::vector<std::string> params;
-		params.push_back(target);
-
-		std::string notice = MessageBuilder::buildCommandMessage(
-			prefix, "NOTICE", params, message
-		);
+	++m_relay_round;
+	claimRecipient(client.getFD(), std::vector<Channel*>());	// the sender never gets a copy
+	bool echo = client.hasCap(CAP_ECHO_MESSAGE);
+	std::vector<Channel*> log_channels;
+	for (std::size_t i = 0; i < names.size(); ++i) {
+		if (channels[i] && channels[i]->hasBroadcastLog()) {
+			const HistoryEntry& entry = broadcastWithHistory(*channels[i], lines[i], client.getFD());
+			if (echo)
+				sendEntry(client, entry);
+			log_channels.push_back(channels[i]);
+		}
+	}
+	for (std::size_t i = 0; i < names.size(); ++i) {
+		if (users[i]) {
+			const HistoryEntry& entry = tagDirectMessage(lines[i]);
+			if (claimRecipient(users[i]->getFD(), log_channels))
+				sendEntry(*users[i], entry);
+			if (echo)
+				sendEntry(client, entry);
+			continue;
+		}
+		if (!channels[i] || channels[i]->hasBroadcastLog())
+			continue;
+		const HistoryEntry& entry = channels[i]->recordHistory(m_next_msgid++, Clock::wallMillis(),
+			lines[i], client.getFD());
+		const std::map<int, Client*>& members = channels[i]->getMembers();
+		for (std::map<int, Client*>::const_iterator it = members.begin(); it != members.end(); ++it) {
+			if (claimRecipient(it->first, log_channels))
+				sendEntry(*it->second, entry);
+		}
+		if (echo)
+			sendEntry(client, entry);
+	}
+}
 
-		// Send to target user
-		sendReply(*target_client, notice);
+// Channel a PRIVMSG/NOTICE may go to, or NULL (with the error reply if send_errors)
+Channel* CommandHandler::resolveRelayChannel(Client& client, const std::string& name, bool send_errors) {
+	Channel* chan = m_server.findChannel(name);
+	if (!chan) {
+		if (send_errors)
+			sendError(client, ERR_NOSUCHCHANNEL, name, "No such channel");
+		return NULL;
+	}
+	// Only members may talk to a channel
+	if (!chan->isMember(client.getFD())) {
+		if (send_errors)
+			sendError(client, ERR_CANNOTSENDTOCHAN, name, "Cannot send to channel");
+		return NULL;
+	}
+	return chan;
+}
 
-		// std::cout << "NOTICE from " << client.getNickname()
-		// 			<< " to " << target << ": " << message << "\n";
+/**
+ * @brief Reserve a recipient for the message being relayed (relayMessage with several targets)
+ * @param fd Recipient
+ * @param log_channels Broadcast-log channels already delivered to (their members have their copy)
+ * @return True the first time fd is seen in this round
+ * 
+ * Marks are round numbers in a vector indexed by fd, so starting a round is O(1)
+ * and nothing is cleared between messages.
+ */
+bool CommandHandler::claimRecipient(int fd, const std::vector<Channel*>& log_channels) {
+	if (fd < 0)
+		return false;
+	if (static_cast<std::size_t>(fd) >= m_relay_marks.size())
+		m_relay_marks.resize(fd + 1, 0);
+	if (m_relay_marks[fd] == m_relay_round)
+		return false;
+	m_relay_marks[fd] = m_relay_round;
+	for (std::size_t i = 0; i < log_channels.size(); ++i) {
+		if (log_channels[i]->isMember(fd))
+			return false;
 	}
+	return true;
 }
 
 /**
- * @brief Handle JOIN command - join or create a channel
- * Format: JOIN <channel> [key]
+ * @brief Handle JOIN command - join or create one or more channels
+ * Format: JOIN <channel>{,<channel>} [<key>{,<key>}]
+ * Keys pair with channels by position. The whole list is one dispatch: replies to
+ * the joiner are queued in order and POLLOUT is enabled for it once at the end.
  * @param client Client attempting to join
- * @param msg Parsed IRC message containing channel name and optional key
+ * @param msg Parsed IRC message containing channel names and optional keys
  */
 void CommandHandler::handleJoin(Client& client, const Message& msg) {
 	// Check if client is registered
@@ -697,18 +936,36 @@ void CommandHandler::handleJoin(Client& client, const Message& msg) {
 		return;
 	}
 
-	std::string channel_name = msg.params[0];
-	std::string key = (msg.params.size() > 1) ? msg.params[1] : "";
+	std::vector<std::string> channels = splitList(msg.params[0]);
+	std::vector<std::string> keys;
+	if (msg.params.size() > 1)
+		keys = splitList(msg.params[1]);
+	holdPollout(client);
+	for (std::size_t i = 0; i < channels.size(); ++i) {
+		if (!channels[i].empty())
+			joinChannel(client, channels[i], (i < keys.size()) ? keys[i] : "");
+	}
+	releasePollout(client);
+}
 
+/**
+ * @brief Join (or create) one channel for handleJoin
+ * @param client Joining client
+ * @param channel_name Channel from the JOIN list
+ * @param key Matching key from the key list (may be empty)
+ */
+void CommandHandler::joinChannel(Client& client, const std::string& channel_name, const std::string& key) {
 	// Validate channel name
 	if (!isValidChannelName(channel_name)) {
 		sendError(client, ERR_NOSUCHCHANNEL, channel_name, "Invalid channel name");
 		return;
 	}
 
-	// Find or create channel
+	// Find or create channel; joining a channel twice is a no-op
 	Channel* chan = m_server.findChannel(channel_name);
 	bool is_new_channel = (chan == nullptr);
+	if (chan && chan->isMember(client.getFD()))
+		return;
 
 	if (is_new_channel)
 	{
@@ -750,8 +1007,10 @@ void CommandHandler::handleJoin(Client& client, const Message& msg) {
 		}
 	}
 
-	// Add client to channel
+	// Add client to channel; big channels switch to the broadcast log for good
 	chan->addMember(&client);
+	if (m_server.getLogMinMembers() > 0 && chan->getMembers().size() >= m_server.getLogMinMembers())
+		chan->enableBroadcastLog();
 
 	// Remove from invited list after successful join
 	if (chan->isInvited(client.getFD()))
@@ -766,41 +1025,11 @@ void CommandHandler::handleJoin(Client& client, const Message& msg) {
 		prefix, "JOIN", empty_params, channel_name
 	);
 
-	// Broadcast JOIN to all members (including sender)
-	broadcastToChannel(*chan, join_msg);
+	// Broadcast JOIN to all members including sender (only operators see non-ops joining a +u channel)
+	broadcastMembership(*chan, client, join_msg);
 
 	// std::cout << client.getNickname() << " joined " << channel_name << "\n";
 
-	// Send NAMES list (RPL_NAMREPLY + RPL_ENDOFNAMES)
-	// Build list of nicknames with @ prefix for operators
-	std::string names_list;
-	const std::map<int, Client*>& members = chan->getMembers();
-
-	for (std::map<int, Client*>::const_iterator it = members.begin();
-		it != members.end(); ++it)
-	{
-		if (it != members.begin())
-			names_list += " ";
-		
-		// Add @ prefix for operators
-		if (chan->isOperator(it->first))
-			names_list += "@";
-		
-		names_list += it->second->getNickname();
-	}
-
-	// RPL_NAMREPLY (353): :server 353 nick = #channel :names
-	std::string names_reply = ":" + m_server_name + " 353 " +
-								client.getNickname() + " = " +
-								channel_name + " :" + names_list + "\r\n";
-	sendReply(client, names_reply);
-
-	// RPL_ENDOFNAMES (366): :server 366 nick #channel :End of /NAMES list
-	std::string endofnames = ":" + m_server_name + " 366 " +
-                        		client.getNickname() + " " +
-                        		channel_name + " :End of /NAMES list\r\n";
-	sendReply(client, endofnames);
-
 	// Send TOPIC if set
 	if (chan->hasTopic())
 	{
@@ -817,13 +1046,19 @@ void CommandHandler::handleJoin(Client& client, const Message& msg) {
                         		channel_name + " :No topic is set\r\n";
     	sendReply(client, notopic);
 	}
+
+	// NAMES list (RPL_NAMREPLY... + RPL_ENDOFNAMES), generated as the socket drains;
+	// no-implicit-names clients ask with NAMES when (and if) they need it
+	if (!client.hasCap(CAP_NO_IMPLICIT_NAMES))
+		sendNames(client, channel_name);
 }
 
 /**
- * @brief Handle PART command - client leaves a channel
- * Syntax: PART <channel> [<reason>]
+ * @brief Handle PART command - client leaves one or more channels
+ * Syntax: PART <channel>{,<channel>} [<reason>]
+ * Like JOIN, the whole list is one dispatch with a single POLLOUT update for the client.
  * @param client Client issuing the PART command
- * @param msg Parsed IRC message containing channel name and optional reason
+ * @param msg Parsed IRC message containing channel names and optional reason
  */
 void CommandHandler::handlePart(Client& client, const Message& msg) {
 	// Check if client is registered
@@ -840,9 +1075,22 @@ void CommandHandler::handlePart(Client& client, const Message& msg) {
 		return;
 	}
 
-	std::string channel_name = msg.params[0];
-	std::string reason = msg.trailing;
+	std::vector<std::string> channels = splitList(msg.params[0]);
+	holdPollout(client);
+	for (std::size_t i = 0; i < channels.size(); ++i) {
+		if (!channels[i].empty())
+			partChannel(client, channels[i], msg.trailing);
+	}
+	releasePollout(client);
+}
 
+/**
+ * @brief Leave one channel for handlePart
+ * @param client Leaving client
+ * @param channel_name Channel from the PART list
+ * @param reason Part message (may be empty)
+ */
+void CommandHandler::partChannel(Client& client, const std::string& channel_name, const std::string& reason) {
 	// Find channel
 	Channel* chan = m_server.findChannel(channel_name);
 
@@ -870,8 +1118,8 @@ void CommandHandler::handlePart(Client& client, const Message& msg) {
 		prefix, "PART", params, reason
 	);
 
-	// Broadcast PART to all channel members (including sender)
-	broadcastToChannel(*chan, part_msg);
+	// Broadcast PART to all channel members including sender (operators only for non-ops in +u)
+	broadcastMembership(*chan, client, part_msg);
 
 	// std::cout << client.getNickname() << " left " << channel_name;
 	// if (!reason.empty())
@@ -1184,7 +1432,7 @@ void CommandHandler::handleTopic(Client& client, const Message& msg) {
 		);
 
 		// Broadcast TOPIC change to all channel members
-		broadcastToChannel(*chan, topic_msg);
+		broadcastWithHistory(*chan, topic_msg);
 
 		// std::cout << client.getNickname() << " set topic for "
 		// 			<< channel_name << ": " << new_topic << "\n";
@@ -1367,6 +1615,8 @@ void CommandHandler::handleChannelMode(Client& client, const Message& msg, const
 			modes += 'i';
 		if (chan->isTopicProtected())
 			modes += 't';
+		if (chan->isAuditorium())
+			modes += 'u';
 		if (chan->hasKey())
 		{
 			modes += 'k';
@@ -1463,6 +1713,22 @@ void CommandHandler::handleChannelMode(Client& client, const Message& msg, const
                 }
 				break;
 			}
+			case 'u':
+			{
+				// Auditorium mode: non-operator JOIN/PART/QUIT/NICK only reach operators
+				bool new_state = (action == '+');
+				if (chan->isAuditorium() != new_state)
+				{
+					chan->setAuditorium(new_state);
+					if (current_action != action)
+					{
+						applied_modes += action;
+						current_action = action;
+					}
+					applied_modes += 'u';
+				}
+				break;
+			}
 			case 'k':
 			{
 				// Channel key mode
@@ -1632,46 +1898,123 @@ void CommandHandler::handleChannelMode(Client& client, const Message& msg, const
 }
 
 /**
- * @brief Handle CAP command - capability negotiation
- * Format: CAP <subcommand> [:<capabilities>]
+ * @brief Handle CAP command - IRCv3 capability negotiation
+ * Format: CAP LS [<version>] | CAP LIST | CAP REQ :<cap> [-<cap> ...] | CAP END
  * @param client Client issuing CAP
- * @param msg Parsed IRC message containing subcommand and optional capabilities
+ * @param msg Parsed IRC message containing subcommand and optional argument
  * 
- * Miminal implementation for irssi compatibility.
- * We don't support any capabilities, just acknowledge the negotiation.
+ * CAPABILITIES is the registry of what LS offers; each client keeps the enabled
+ * ones as a bitset that handlers test with Client::hasCap. REQ is atomic: one
+ * unknown name NAKs the whole request. A client that sends LS or REQ before
+ * registering is held until CAP END (tryRegister).
  */
 void CommandHandler::handleCap(Client& client, const Message& msg) {
 	// CAP command doesn't require registration
-	if (msg.params.empty())
+	if (msg.params.empty()) {
+		sendError(client, ERR_NEEDMOREPARAMS, "CAP", "Not enough parameters");
 		return;
-	
+	}
+
 	std::string subcommand = msg.params[0];
+	for (std::size_t i = 0; i < subcommand.size(); ++i)
+		subcommand[i] = std::toupper(static_cast<unsigned char>(subcommand[i]));
+	// The argument may come as a middle parameter or as the trailing one
+	std::string arg = (msg.params.size() > 1) ? msg.params[1] : msg.trailing;
+	// Format: :server CAP <nick|*> <subcommand> [*] :<list>
+	std::string head = ":" + m_server_name + " CAP " +
+		(client.getNickname().empty() ? "*" : client.getNickname()) + " ";
 
 	if (subcommand == "LS")
 	{
-		// Client requests list of capabilities
-		std::string cap_reply = ":ircserv CAP " + 
-                                (client.getNickname().empty() ? "*" : client.getNickname()) +
-                                " LS :\r\n";
-        sendReply(client, cap_reply);
-		// std::cout << "Client fd " << client.getFD() << " CAP LS (empty list sent)\n";
+		if (!client.isRegistered())
+			client.setCapNegotiating(true);
+		if (!arg.empty() && arg.find_first_not_of("0123456789") == std::string::npos && arg.size() < 6)
+			client.setCapVersion(std::atoi(arg.c_str()));
+		std::vector<std::string> offered;
+		for (std::size_t i = 0; i < CAPABILITY_COUNT; ++i) {
+			std::string token = CAPABILITIES[i].name;
+			if (client.getCapVersion() >= 302 && CAPABILITIES[i].value[0] != '\0')
+				token += std::string("=") + CAPABILITIES[i].value;
+			offered.push_back(token);
+		}
+		sendCapList(client, head + "LS ", offered);
 	}
-	else if (subcommand == "END")
+	else if (subcommand == "LIST")
 	{
-		// Client finished capability negotiation
-		// std::cout << "Client fd " << client.getFD() << " CAP END\n";
-		// Nothing to do, client will continue with PASS/NICK/USER
+		std::vector<std::string> enabled;
+		for (std::size_t i = 0; i < CAPABILITY_COUNT; ++i) {
+			if (client.hasCap(CAPABILITIES[i].cap))
+				enabled.push_back(CAPABILITIES[i].name);
+		}
+		sendCapList(client, head + "LIST ", enabled);
 	}
 	else if (subcommand == "REQ")
 	{
-		// Client requests specific capabilities
-		// We support none, so send NAK (negative acknowledgement)
-		std::string cap_reply = ":ircserv CAP " + 
-                                (client.getNickname().empty() ? "*" : client.getNickname()) +
-                                " NAK :" + msg.trailing + "\r\n";
-		sendReply(client, cap_reply);
-		// std::cout << "Client fd " << client.getFD() << " CAP REQ (rejected)\n";
+		if (!client.isRegistered())
+			client.setCapNegotiating(true);
+		// Validate every name first, then apply them all (or none)
+		std::vector<std::pair<Capability, bool> > changes;
+		std::size_t start = 0;
+		while (start < arg.size()) {
+			std::size_t end = arg.find(' ', start);
+			if (end == std::string::npos)
+				end = arg.size();
+			std::string name = arg.substr(start, end - start);
+			start = end + 1;
+			if (name.empty())
+				continue;
+			bool enable = (name[0] != '-');
+			if (!enable)
+				name.erase(0, 1);
+			const CapabilityInfo* info = findCapability(name);
+			if (!info) {
+				changes.clear();
+				break;
+			}
+			changes.push_back(std::make_pair(info->cap, enable));
+		}
+		if (changes.empty()) {
+			// NAK (negative acknowledgement) echoes the request unchanged
+			sendReply(client, head + "NAK :" + arg + "\r\n");
+			return;
+		}
+		for (std::size_t i = 0; i < changes.size(); ++i)
+			client.setCap(changes[i].first, changes[i].second);
+		sendReply(client, head + "ACK :" + arg + "\r\n");
+	}
+	else if (subcommand == "END")
+	{
+		// Client finished capability negotiation: registration may complete now
+		if (!client.isRegistered()) {
+			client.setCapNegotiating(false);
+			tryRegister(client);
+		}
+	}
+	else
+		sendError(client, ERR_INVALIDCAPCMD, msg.params[0], "Invalid CAP command");
+}
+
+/**
+ * @brief Send a CAP LS/LIST reply, split over several lines if it does not fit in one
+ * Format: <head>* :<caps>  (continuation lines, CAP 302 clients only), then <head>:<caps>
+ * @param client Target client
+ * @param head ":server CAP <nick> <subcommand> "
+ * @param caps Capability tokens
+ */
+void CommandHandler::sendCapList(Client& client, const std::string& head, const std::vector<std::string>& caps) {
+	std::string list;
+	for (std::size_t i = 0; i < caps.size(); ++i) {
+		// "* :" + list + "\r\n" must stay within one IRC line
+		if (!list.empty() && client.getCapVersion() >= 302 &&
+			head.size() + 3 + list.size() + 1 + caps[i].size() + 2 > MAX_MESSAGE_LENGTH) {
+			sendReply(client, head + "* :" + list + "\r\n");
+			list.clear();
+		}
+		if (!list.empty())
+			list += ' ';
+		list += caps[i];
 	}
+	sendReply(client, head + ":" + list + "\r\n");
 }
 
 /**
@@ -1703,45 +2046,11 @@ void CommandHandler::handleWho(Client& client, const Message& msg) {
 	// Check if target is a channel
 	if (!target.empty() && target[0] == '#')
 	{
-		// Find channel
-		Channel* chan = m_server.findChannel(target);
-
-		if (!chan)
-		{
-			// Channel doesn't exist - send end of WHO with no entries
-			sendNumeric(client, RPL_ENDOFWHO, target + " :End of WHO list");
-			return;
-		}
-
-		// Send RPL_WHOREPLY for each member in the channel
-		const std::map<int, Client*>& members = chan->getMembers();
-
-		for (std::map<int, Client*>::const_iterator it = members.begin();
-			it != members.end(); ++it)
-		{
-			Client* member = it->second;
-
-			// Build WHO reply
-            // Format: :server 352 nick <channel> <user> <host> <server> <nick> <flags> :<hopcount> <realname>
-            // Flags: H = here, G = gone (away), @ = operator, + = voice
-            std::string flags = "H";	// H = here (not away)
-            if (chan->isOperator(member->getFD()))
-                flags += "@";
-            
-            std::string who_msg = ":" + m_server_name + " 352 " +
-                            	client.getNickname() + " " +
-                                target + " " +						// channel (no colon!)
-                                member->getUsername() + " " +
-                                "localhost" + " " +
-                                m_server_name + " " +
-                                member->getNickname() + " " +
-                                flags + " :0 " +					// colon before hopcount
-                                member->getRealname() + "\r\n";	// realname
-            sendReply(client, who_msg);
-		}
-		
-		// Send end of WHO list
-		sendNumeric(client, RPL_ENDOFWHO, target + " :End of WHO list");
+		// RPL_WHOREPLY for each member, then RPL_ENDOFWHO: generated as the socket drains
+		// (a channel that does not exist gets RPL_ENDOFWHO only)
+		client.pushReplyStream(std::unique_ptr<ReplyStream>(
+			new WhoStream(m_server, m_server_name, target, newBatchRef(client))));
+		++m_fanout;
 		// std::cout << client.getNickname() << " queried WHO for " << target << "\n";
 	}
 	else
@@ -1770,6 +2079,184 @@ void CommandHandler::handleWho(Client& client, const Message& msg) {
 	}
 }
 
+/**
+ * @brief Handle NAMES command - list the members of channels
+ * Format: NAMES [<channel>{,<channel>}]
+ * @param client Client issuing NAMES
+ * @param msg Parsed IRC message containing the channel list
+ * 
+ * Without a parameter only RPL_ENDOFNAMES is sent (listing every channel
+ * on the server is not supported).
+ */
+void CommandHandler::handleNames(Client& client, const Message& msg) {
+	if (!client.isRegistered()) {
+		sendError(client, ERR_NOTREGISTERED, "", "You have not registered");
+		return;
+	}
+	if (msg.params.empty()) {
+		sendReply(client, ":" + m_server_name + " 366 " + client.getNickname() + " * :End of /NAMES list\r\n");
+		return;
+	}
+	std::string list = msg.params[0];
+	std::size_t start = 0;
+	while (start <= list.size()) {
+		std::size_t comma = list.find(',', start);
+		if (comma == std::string::npos)
+			comma = list.size();
+		if (comma > start)
+			sendNames(client, list.substr(start, comma - start));
+		start = comma + 1;
+	}
+}
+
+/**
+ * @brief Queue RPL_NAMREPLY lines + RPL_ENDOFNAMES for one channel as a streamed reply
+ * @param client Requester
+ * @param channel_name Channel to list (a missing channel gets RPL_ENDOFNAMES only)
+ */
+void CommandHandler::sendNames(Client& client, const std::string& channel_name) {
+	client.pushReplyStream(std::unique_ptr<ReplyStream>(
+		new NamesStream(m_server, m_server_name, channel_name, newBatchRef(client))));
+	++m_fanout;
+}
+
+/**
+ * @brief Parse a CHATHISTORY message reference
+ * @param text "msgid=<id>" or "timestamp=<server-time>"
+ * @param by_time Set when the reference is a timestamp
+ * @param value Receives the msgid or the time in milliseconds
+ * @return False if the reference is malformed
+ */
+static bool parseHistoryRef(const std::string& text, bool& by_time, std::uint64_t& value) {
+	if (text.compare(0, 6, "msgid=") == 0) {
+		std::string id = text.substr(6);
+		if (id.empty() || id.find_first_not_of("0123456789") != std::string::npos || id.size() > 19)
+			return false;
+		by_time = false;
+		value = std::strtoull(id.c_str(), nullptr, 10);
+		return true;
+	}
+	if (text.compare(0, 10, "timestamp=") == 0) {
+		by_time = true;
+		return MessageBuilder::parseServerTime(text.substr(10), value);
+	}
+	return false;
+}
+
+/**
+ * @brief Binary search the channel history for a message reference
+ * @param chan Channel whose history ring is searched
+ * @param by_time Compare timestamps instead of msgids
+ * @param ref Reference value
+ * @param past_ref Return the first entry after ref instead of the first one at or after it
+ * @return Index into the history (getHistorySize() if there is no such entry)
+ */
+static std::size_t historyBound(const Channel& chan, bool by_time, std::uint64_t ref, bool past_ref) {
+	std::size_t lo = 0;
+	std::size_t hi = chan.getHistorySize();
+	while (lo < hi) {
+		std::size_t mid = lo + (hi - lo) / 2;
+		const HistoryEntry& entry = chan.getHistoryAt(mid);
+		std::uint64_t key = by_time ? entry.time_ms : entry.msgid;
+		if (key < ref || (past_ref && key == ref))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * @brief Handle CHATHISTORY command - replay recent messages of a channel
+ * Format: CHATHISTORY LATEST <channel> <* | msgid=<id> | timestamp=<time>> <limit>
+ *         CHATHISTORY BEFORE <channel> <msgid=<id> | timestamp=<time>> <limit>
+ *         CHATHISTORY AFTER <channel> <msgid=<id> | timestamp=<time>> <limit>
+ * @param client Client issuing CHATHISTORY (must be on the channel)
+ * @param msg Parsed IRC message
+ * 
+ * Lines come from the channel's history ring exactly as they were broadcast,
+ * oldest first. BEFORE/AFTER exclude the referenced message; LATEST with a
+ * reference returns the newest messages after it, so a client that knows the
+ * last message it saw gets exactly what it missed (up to the ring's size).
+ * msgids increase server-wide, so a reference that already left the ring still
+ * selects the right range. At most CHATHISTORY_MAX_LIMIT lines are returned.
+ */
+void CommandHandler::handleChatHistory(Client& client, const Message& msg) {
+	if (!client.isRegistered()) {
+		sendError(client, ERR_NOTREGISTERED, "", "You have not registered");
+		return;
+	}
+	std::vector<std::string> args = msg.params;
+	if (msg.hasTrailing())
+		args.push_back(msg.trailing);
+	if (args.size() < 4) {
+		sendError(client, ERR_NEEDMOREPARAMS, "CHATHISTORY", "Not enough parameters");
+		return;
+	}
+
+	std::string subcommand = args[0];
+	for (std::size_t i = 0; i < subcommand.size(); ++i)
+		subcommand[i] = std::toupper(static_cast<unsigned char>(subcommand[i]));
+	if (subcommand != "LATEST" && subcommand != "BEFORE" && subcommand != "AFTER") {
+		sendFail(client, "CHATHISTORY", "INVALID_PARAMS", args[0], "Unknown subcommand");
+		return;
+	}
+
+	const std::string& target = args[1];
+	Channel* chan = m_server.findChannel(target);
+	if (!chan || !chan->isMember(client.getFD())) {
+		sendFail(client, "CHATHISTORY", "INVALID_TARGET", subcommand + " " + target, "Messages could not be retrieved");
+		return;
+	}
+
+	bool by_time = false;
+	std::uint64_t ref = 0;
+	bool no_ref = (subcommand == "LATEST" && args[2] == "*");
+	if (!no_ref && !parseHistoryRef(args[2], by_time, ref)) {
+		sendFail(client, "CHATHISTORY", "INVALID_PARAMS", args[2], "Invalid message reference");
+		return;
+	}
+
+	const std::string& limit_text = args[3];
+	if (limit_text.empty() || limit_text.size() > 9 || limit_text.find_first_not_of("0123456789") != std::string::npos
+		|| std::atoi(limit_text.c_str()) == 0) {
+		sendFail(client, "CHATHISTORY", "INVALID_PARAMS", limit_text, "Invalid limit");
+		return;
+	}
+	std::size_t limit = std::min(static_cast<std::size_t>(std::atoi(limit_text.c_str())), CHATHISTORY_MAX_LIMIT);
+
+	// Ring entries are ordered by msgid and by time: [before, after) holds the entries equal to ref
+	std::size_t size = chan->getHistorySize();
+	std::size_t before = no_ref ? size : historyBound(*chan, by_time, ref, false);
+	std::size_t after = no_ref ? 0 : historyBound(*chan, by_time, ref, true);
+
+	std::size_t first;
+	std::size_t last;
+	if (subcommand == "BEFORE") {
+		last = before;
+		first = last > limit ? last - limit : 0;
+	} else if (subcommand == "AFTER") {
+		first = after;
+		last = std::min(size, first + limit);
+	} else {
+		last = size;
+		first = after;
+		if (last - first > limit)
+			first = last - limit;
+	}
+	// Format: :server BATCH +<ref> chathistory <target> ... :server BATCH -<ref> (batch clients only)
+	std::string batch = newBatchRef(client);
+	std::string batch_tag;
+	if (!batch.empty()) {
+		MessageBuilder::appendTag(batch_tag, "batch", batch);
+		sendReply(client, ":" + m_server_name + " BATCH +" + batch + " chathistory " + target + "\r\n");
+	}
+	for (std::size_t i = first; i < last; ++i)
+		sendEntry(client, chan->getHistoryAt(i), batch_tag);
+	if (!batch.empty())
+		sendReply(client, ":" + m_server_name + " BATCH -" + batch + "\r\n");
+}
+
 /**
  * @brief Main command dispatcher - routes commands to appropriate handlers.
  * @param raw_command Complete IRC command with \r\n
@@ -1782,6 +2269,20 @@ void CommandHandler::handleCommand(const std::string& raw_command, Client& clien
 
 		// std::cout << "Parsed command: " << msg.command << " from fd " << client.getFD() << "\n";
 
+		// Under load shedding, postpone expensive commands until the loop recovers.
+		// The server stops dispatching this client's later commands until the replay,
+		// so replies keep command order and a client holds at most one deferred command.
+		if (m_server.isShedding() && isExpensiveCommand(msg.command)) {
+			client.deferCommand(raw_command);
+			++m_deferred_count;
+			return;
+		}
+
+		TraceSpan span("command", msg.command.c_str());
+		m_fanout = 0;
+		m_held_pollout_fd = -1;	// a hold left by an exception must not outlive its command
+		IRC_PROBE2(command_start, client.getFD(), msg.command.c_str());
+
 		// Route to appropriate command handler
 		if (msg.command == "PASS")
 			handlePass(client, msg);
@@ -1813,6 +2314,10 @@ void CommandHandler::handleCommand(const std::string& raw_command, Client& clien
 			handleCap(client, msg);
 		else if (msg.command == "WHO")
 			handleWho(client, msg);
+		else if (msg.command == "NAMES")
+			handleNames(client, msg);
+		else if (msg.command == "CHATHISTORY")
+			handleChatHistory(client, msg);
 		else {
 			// Command not recognized or not implemented
 			std::string error = MessageBuilder::buildErrorReply(
@@ -1822,9 +2327,11 @@ void CommandHandler::handleCommand(const std::string& raw_command, Client& clien
 			);
 			sendReply(client, error);
 		}
+		IRC_PROBE3(command_done, client.getFD(), msg.command.c_str(), m_fanout);
 	} catch (const std::exception& e) {
 		// Log parsing errors but don't crash the server
-		std::cerr << "Error parsing command from fd " << client.getFD()
-				<< ": " << e.what() << "\n";
+		LOGW("Error parsing command from fd %d: %s", client.getFD(), e.what());
 	}
 }
+
+std::size_t CommandHandler::getDeferredCount() const { return m_deferred_count; }
@@ -6,6 +6,35 @@
  */
 
 #include "protocol/MessageBuilder.hpp"
+#include <cstdio>
+#include <ctime>
+
+/**
+ * @brief Look up a tag by key
+ * 
+ * @param key Tag key (client-only tags include their '+')
+ * @param value Receives the unescaped value ("" for a tag without value)
+ * @return True if the tag is present
+ * 
+ * Tags stay as one raw view until someone asks: the lookup walks the section
+ * and only the value that was asked for is unescaped.
+ */
+bool Message::getTag(std::string_view key, std::string& value) const {
+	std::size_t start = 0;
+	while (start < tags.size()) {
+		std::size_t end = tags.find(';', start);
+		if (end == std::string_view::npos)
+			end = tags.size();
+		std::string_view tag = tags.substr(start, end - start);
+		std::size_t eq = tag.find('=');
+		if (tag.substr(0, eq) == key) {
+			value = (eq == std::string_view::npos) ? "" : MessageBuilder::unescapeTagValue(tag.substr(eq + 1));
+			return true;
+		}
+		start = end + 1;
+	}
+	return false;
+}
 
 /**
  * @brief Check if the message has a prefix
@@ -202,3 +231,137 @@ std::string MessageBuilder::buildCommandMessage(const std::string& prefix, const
 
 	return result;
 }
+
+/**
+ * @brief Format a timestamp the way IRCv3 server-time does
+ * 
+ * @param time_ms Milliseconds since the Unix epoch
+ * @return UTC time with millisecond precision (e.g., "2025-12-21T18:04:05.123Z")
+ */
+std::string MessageBuilder::formatServerTime(std::uint64_t time_ms) {
+	std::time_t seconds = static_cast<std::time_t>(time_ms / 1000);
+	std::tm utc;
+	gmtime_r(&seconds, &utc);
+
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%03uZ",
+		utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+		utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<unsigned>(time_ms % 1000));
+	return buf;
+}
+
+/**
+ * @brief Parse a server-time timestamp (inverse of formatServerTime)
+ * 
+ * @param text Timestamp, milliseconds optional ("2025-12-21T18:04:05Z" is accepted)
+ * @param time_ms Receives milliseconds since the Unix epoch
+ * @return False if the text is not a UTC timestamp
+ */
+bool MessageBuilder::parseServerTime(const std::string& text, std::uint64_t& time_ms) {
+	std::tm utc = std::tm();
+	unsigned millis = 0;
+	int used = 0;
+
+	if (std::sscanf(text.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%n",
+			&utc.tm_year, &utc.tm_mon, &utc.tm_mday,
+			&utc.tm_hour, &utc.tm_min, &utc.tm_sec, &used) != 6)
+		return false;
+	std::string rest = text.substr(used);
+	if (rest.size() == 5 && rest[0] == '.' && std::sscanf(rest.c_str(), ".%3u", &millis) == 1)
+		rest = rest.substr(4);
+	if (rest != "Z")
+		return false;
+
+	utc.tm_year -= 1900;
+	utc.tm_mon -= 1;
+	std::time_t seconds = timegm(&utc);
+	if (seconds < 0)
+		return false;
+	time_ms = static_cast<std::uint64_t>(seconds) * 1000 + millis;
+	return true;
+}
+
+/**
+ * @brief Append one tag to an IRCv3 tag section
+ * 
+ * @param tags Tag section being built ("" for the first tag, then "@a=b;...")
+ * @param key Tag key
+ * @param value Tag value, escaped here (';' -> "\:", ' ' -> "\s", '\' -> "\\", CR -> "\r", LF -> "\n"); omitted when empty
+ * 
+ * The caller adds the space that ends the section before the message itself.
+ */
+void MessageBuilder::appendTag(std::string& tags, const std::string& key, const std::string& value) {
+	tags += tags.empty() ? '@' : ';';
+	tags += key;
+	if (value.empty())
+		return;
+	tags += '=';
+	for (std::size_t i = 0; i < value.size(); ++i) {
+		switch (value[i]) {
+			case ';':	tags += "\\:"; break;
+			case ' ':	tags += "\\s"; break;
+			case '\\':	tags += "\\\\"; break;
+			case '\r':	tags += "\\r"; break;
+			case '\n':	tags += "\\n"; break;
+			default:	tags += value[i];
+		}
+	}
+}
+
+/**
+ * @brief Undo tag value escaping
+ * 
+ * @param value Raw value as received
+ * @return Unescaped value; an unknown escape keeps the escaped character, a trailing '\' is dropped
+ */
+std::string MessageBuilder::unescapeTagValue(std::string_view value) {
+	std::string result;
+	result.reserve(value.size());
+	for (std::size_t i = 0; i < value.size(); ++i) {
+		if (value[i] != '\\') {
+			result += value[i];
+			continue;
+		}
+		if (++i == value.size())
+			break;
+		switch (value[i]) {
+			case ':':	result += ';'; break;
+			case 's':	result += ' '; break;
+			case 'r':	result += '\r'; break;
+			case 'n':	result += '\n'; break;
+			default:	result += value[i];
+		}
+	}
+	return result;
+}
+
+/**
+ * @brief Serialize a message with its msgid and server-time tags
+ * 
+ * @param out Receives "@msgid=<id>;time=<server-time> <message>" (capacity is reused)
+ * @param msgid Server-wide message id
+ * @param time_ms Milliseconds since the Unix epoch
+ * @param message Serialized message including \r\n
+ * @param time_pos Receives the offset of "time=" in out
+ * @return Size of the tag section including its trailing space
+ * 
+ * The tags are laid out so that each client variant is a slice of out:
+ * everything (message-tags), "@" + out[time_pos..] (server-time only) or
+ * out[size..] (no tags). A broadcast serializes tags once, whatever the audience.
+ */
+std::size_t MessageBuilder::buildTaggedLine(std::string& out, std::uint64_t msgid, std::uint64_t time_ms,
+	const std::string& message, std::size_t& time_pos) {
+	std::time_t seconds = static_cast<std::time_t>(time_ms / 1000);
+	std::tm utc;
+	gmtime_r(&seconds, &utc);
+
+	char tags[96];
+	int id_len = std::snprintf(tags, sizeof(tags), "@msgid=%llu;", static_cast<unsigned long long>(msgid));
+	int len = id_len + std::snprintf(tags + id_len, sizeof(tags) - id_len, "time=%04d-%02d-%02dT%02d:%02d:%02d.%03uZ ",
+		utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+		utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<unsigned>(time_ms % 1000));
+	out.assign(tags, len);
+	out.append(message);
+	time_pos = id_len;
+	return len;
+}
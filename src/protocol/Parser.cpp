@@ -1,12 +1,16 @@
 /**
  * @brief IRC message parser implementation
  * 
- * Implements IRC message parsing logic according to RFC 1459 format:
- * [:<prefix>] <command> [<params>] [:<trailing>]
+ * Implements IRC message parsing logic according to RFC 1459 format,
+ * with the IRCv3 message-tags section in front:
+ * [@<tags>] [:<prefix>] <command> [<params>] [:<trailing>]
  */
 
 #include "protocol/Parser.hpp"
 
+// IRCv3 limit for the tag section, '@' and the separating space included
+static const std::size_t	MAX_TAGS_LENGTH = 8191;
+
 /**
  * @brief Remove \r\n from the end of string
  * 
@@ -31,6 +35,37 @@ std::string Parser::stripCRLF(const std::string& str) {
 	return str;
 }
 
+/**
+ * @brief Split off the IRCv3 tag section
+ * 
+ * @param raw Raw IRC message
+ * @param[out] tags View of the tags without '@' (empty if there are none)
+ * @return Offset of the message after the tag section (0 if there are no tags)
+ * @throws std::length_error if the tag section is over 8191 bytes
+ * @throws std::invalid_argument if nothing follows the tags
+ * 
+ * Tags are neither split nor unescaped here (see Message::getTag): most
+ * commands never look at them, so the only cost is this one scan.
+ */
+std::size_t Parser::extractTags(const std::string& raw, std::string_view& tags) {
+	tags = std::string_view();
+	if (raw.empty() || raw[0] != '@')
+		return 0;
+
+	size_t spacePos = raw.find(' ');
+	if (spacePos == std::string::npos)
+		throw std::invalid_argument("IRC message must have a command");
+	if (spacePos + 1 > MAX_TAGS_LENGTH)
+		throw std::length_error("IRC message tags exceed 8191 bytes");
+	tags = std::string_view(raw).substr(1, spacePos - 1);
+
+	// Several spaces may separate the tags from the rest
+	size_t start = raw.find_first_not_of(' ', spacePos);
+	if (start == std::string::npos)
+		throw std::invalid_argument("IRC message must have a command");
+	return start;
+}
+
 /**
  * @brief Extract prefix from IRC message
  * 
@@ -161,8 +196,9 @@ Message Parser::parse(const std::string& raw) {
 	// Create empty message structure
 	Message	msg;
 
-	// Remove \r\n from the end
-	std::string line = stripCRLF(raw);
+	// Remove \r\n from the end; the tag section stays a view into raw
+	std::size_t body = extractTags(raw, msg.tags);
+	std::string line = body ? stripCRLF(raw.substr(body)) : stripCRLF(raw);
 
 	// Extract prefix if present
 	msg.prefix = extractPrefix(line);
@@ -0,0 +1,173 @@
+#include "protocol/ReplyStream.hpp"
+#include "protocol/MessageBuilder.hpp"
+#include "network/Server.hpp"
+
+// RFC 1459 line limit including \r\n
+static const std::size_t MAX_LINE = 512;
+
+/*
+ Visible part of a +u (auditorium) channel for a non-operator: the operators and the
+ requester itself, packed into as few RPL_NAMREPLY lines as fit. O(ops), sent in one go.
+*/
+static void appendAudienceNames(Client& client, const Channel& chan, const std::string& head)
+{
+	const std::map<int, Client*>& members = chan.getMembers();
+	const std::set<int>& ops = chan.getOperators();
+	std::vector<std::string> entries;
+	for (std::set<int>::const_iterator it = ops.begin(); it != ops.end(); ++it) {
+		std::map<int, Client*>::const_iterator member = members.find(*it);
+		if (member != members.end())
+			entries.push_back("@" + member->second->getNickname());
+	}
+	if (chan.isMember(client.getFD()))
+		entries.push_back(client.getNickname());
+	std::string line = head;
+	for (std::size_t i = 0; i < entries.size(); ++i) {
+		if (line.size() > head.size() && line.size() + 1 + entries[i].size() + 2 > MAX_LINE) {
+			client.appendToOutBuf(line + "\r\n");
+			line = head;
+		}
+		if (line.size() > head.size())
+			line += ' ';
+		line += entries[i];
+	}
+	if (line.size() > head.size())
+		client.appendToOutBuf(line + "\r\n");
+}
+
+// RPL_WHOREPLY (352) for one member
+static std::string whoLine(const std::string& server_name, const Client& client, const std::string& channel,
+	const Client& member, bool op)
+{
+	return ":" + server_name + " 352 " + client.getNickname() + " " + channel + " " +
+		member.getUsername() + " localhost " + server_name + " " +
+		member.getNickname() + (op ? " H@" : " H") + " :0 " + member.getRealname() + "\r\n";
+}
+
+// "@batch=<ref> " in front of every line of a batched reply, or ""
+static std::string batchTags(const std::string& batch)
+{
+	std::string tags;
+	if (batch.empty())
+		return tags;
+	MessageBuilder::appendTag(tags, "batch", batch);
+	tags += ' ';
+	return tags;
+}
+
+ReplyStream::ReplyStream(Server& server, const std::string& server_name, const std::string& channel,
+	const std::string& batch)
+	: m_server(server), m_server_name(server_name), m_channel(channel),
+	  m_batch(batch), m_tags(batchTags(batch)), m_batch_open(false)
+{}
+
+ReplyStream::~ReplyStream() {}
+
+// Format: :server BATCH +<ref> <type> <channel>
+void ReplyStream::openBatch(Client& client, const char* type) {
+	if (m_batch.empty() || m_batch_open)
+		return;
+	client.appendToOutBuf(":" + m_server_name + " BATCH +" + m_batch + " " + type + " " + m_channel + "\r\n");
+	m_batch_open = true;
+}
+
+// Format: :server BATCH -<ref>
+void ReplyStream::closeBatch(Client& client) {
+	if (m_batch.empty())
+		return;
+	client.appendToOutBuf(":" + m_server_name + " BATCH -" + m_batch + "\r\n");
+}
+
+NamesStream::NamesStream(Server& server, const std::string& server_name, const std::string& channel,
+	const std::string& batch)
+	: ReplyStream(server, server_name, channel, batch), m_next_block(0)
+{}
+
+/**
+ * @brief RPL_NAMREPLY (353): :server 353 nick = #channel :<cached block>
+ * @param client Requester (lines go to its output buffer)
+ * @param high_water Stop once this many bytes are waiting to be sent
+ * @return True when RPL_ENDOFNAMES has been queued
+ *
+ * Each line is the reply prefix plus one pre-serialized block of the
+ * channel's names cache, so a reply costs a copy per ~400 bytes of names
+ * instead of a walk over the members. Blocks never move, so resuming by
+ * index is stable; members who join while the reply is streaming may or
+ * may not be listed, like with any NAMES that races a JOIN.
+ * Non-operators asking about a +u channel only get the operators and themselves.
+ * Batched replies use the (vendor) batch type ircserv/names.
+ */
+bool NamesStream::fill(Client& client, std::size_t high_water) {
+	openBatch(client, "ircserv/names");
+	Channel* chan = m_server.findChannel(m_channel);
+	const std::string head = chan ? m_tags + ":" + m_server_name + " 353 " + client.getNickname() + " = " + m_channel + " :" : "";
+	if (chan && chan->isAuditorium() && !chan->isOperator(client.getFD()))
+		appendAudienceNames(client, *chan, head);
+	else if (chan) {
+		const std::vector<std::string>& blocks = chan->getNamesBlocks();
+		std::string line;
+		while (m_next_block < blocks.size()) {
+			if (client.getOutBuf().size() >= high_water)
+				return false;
+			const std::string& body = blocks[m_next_block++];
+			if (body.empty())
+				continue;
+			line.reserve(head.size() + body.size() + 2);
+			line.assign(head);
+			line.append(body);
+			line.append("\r\n");
+			client.appendToOutBuf(line);
+		}
+	}
+	// RPL_ENDOFNAMES (366): :server 366 nick #channel :End of /NAMES list
+	client.appendToOutBuf(m_tags + ":" + m_server_name + " 366 " + client.getNickname() + " " + m_channel + " :End of /NAMES list\r\n");
+	closeBatch(client);
+	return true;
+}
+
+WhoStream::WhoStream(Server& server, const std::string& server_name, const std::string& channel,
+	const std::string& batch)
+	: ReplyStream(server, server_name, channel, batch), m_last_fd(-1)
+{}
+
+/**
+ * @brief RPL_WHOREPLY (352) per member, resumed after the last fd emitted
+ * Format: :server 352 nick <channel> <user> <host> <server> <nick> <flags> :<hopcount> <realname>
+ * Flags: H = here (no away support), @ = channel operator
+ * A channel that does not exist (or disappears) ends with RPL_ENDOFWHO.
+ * Non-operators asking about a +u channel only see the operators and themselves.
+ * Batched replies use the (vendor) batch type ircserv/who.
+ */
+bool WhoStream::fill(Client& client, std::size_t high_water) {
+	openBatch(client, "ircserv/who");
+	Channel* chan = m_server.findChannel(m_channel);
+	if (chan && chan->isAuditorium() && !chan->isOperator(client.getFD())) {
+		const std::map<int, Client*>& members = chan->getMembers();
+		const std::set<int>& ops = chan->getOperators();
+		std::set<int>::const_iterator it = (m_last_fd < 0) ? ops.begin() : ops.upper_bound(m_last_fd);
+		for (; it != ops.end(); ++it) {
+			if (client.getOutBuf().size() >= high_water)
+				return false;
+			std::map<int, Client*>::const_iterator member = members.find(*it);
+			if (member != members.end())
+				client.appendToOutBuf(m_tags + whoLine(m_server_name, client, m_channel, *member->second, true));
+			m_last_fd = *it;
+		}
+		if (chan->isMember(client.getFD()))
+			client.appendToOutBuf(m_tags + whoLine(m_server_name, client, m_channel, client, false));
+	}
+	else if (chan) {
+		const std::map<int, Client*>& members = chan->getMembers();
+		std::map<int, Client*>::const_iterator it = (m_last_fd < 0) ? members.begin() : members.upper_bound(m_last_fd);
+		for (; it != members.end(); ++it) {
+			if (client.getOutBuf().size() >= high_water)
+				return false;
+			client.appendToOutBuf(m_tags + whoLine(m_server_name, client, m_channel, *it->second, chan->isOperator(it->first)));
+			m_last_fd = it->first;
+		}
+	}
+	// RPL_ENDOFWHO (315): :server 315 nick <channel> :End of WHO list
+	client.appendToOutBuf(m_tags + ":" + m_server_name + " 315 " + client.getNickname() + " " + m_channel + " :End of WHO list\r\n");
+	closeBatch(client);
+	return true;
+}
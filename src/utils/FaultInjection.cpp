@@ -0,0 +1,128 @@
+/**
+ * @brief Seeded fault decisions for the socket wrappers (see FaultInjection.hpp)
+ */
+
+#include "utils/FaultInjection.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+double			g_rate[FaultInjection::KIND_COUNT] = { 0.0, 0.0, 0.0, 0.0 };
+std::uint64_t	g_injected[FaultInjection::KIND_COUNT] = { 0, 0, 0, 0 };
+std::uint64_t	g_state = 1;
+bool			g_enabled = false;
+
+const char* const	KIND_NAMES[FaultInjection::KIND_COUNT] = { "short", "eagain", "eintr", "reset" };
+
+// xorshift64*: cheap, and the sequence depends only on the seed
+std::uint64_t nextRandom() {
+	g_state ^= g_state >> 12;
+	g_state ^= g_state << 25;
+	g_state ^= g_state >> 27;
+	return g_state * 2685821657736338717ull;
+}
+
+bool roll(FaultInjection::Kind kind) {
+	if (g_rate[kind] <= 0.0)
+		return false;
+	if (static_cast<double>(nextRandom() >> 11) / 9007199254740992.0 >= g_rate[kind])
+		return false;
+	++g_injected[kind];
+	return true;
+}
+
+// EINTR / EAGAIN / reset decision shared by all three calls; 0 = no fault
+int pickError(int reset_errno) {
+	if (roll(FaultInjection::Intr))
+		return EINTR;
+	if (roll(FaultInjection::Again))
+		return EAGAIN;
+	if (roll(FaultInjection::Reset))
+		return reset_errno;
+	return 0;
+}
+
+std::size_t shortLength(std::size_t len) {
+	if (len < 2 || !roll(FaultInjection::Short))
+		return len;
+	return 1 + static_cast<std::size_t>(nextRandom() % (len - 1));
+}
+
+}
+
+void FaultInjection::configureFromEnv() {
+	const char* spec = std::getenv("IRCSERV_FAULTS");
+	if (!spec)
+		return;
+	std::string list(spec);
+	std::size_t pos = 0;
+	while (pos < list.size()) {
+		std::size_t end = list.find(',', pos);
+		if (end == std::string::npos)
+			end = list.size();
+		std::string item = list.substr(pos, end - pos);
+		std::size_t eq = item.find('=');
+		if (eq != std::string::npos) {
+			std::string key = item.substr(0, eq);
+			const char* value = item.c_str() + eq + 1;
+			if (key == "seed")
+				g_state = std::strtoull(value, NULL, 10) | 1;	// xorshift state must not be 0
+			for (int k = 0; k < KIND_COUNT; ++k)
+				if (key == KIND_NAMES[k])
+					g_rate[k] = std::strtod(value, NULL);
+		}
+		pos = end + 1;
+	}
+	g_enabled = false;
+	for (int k = 0; k < KIND_COUNT; ++k)
+		g_enabled = g_enabled || g_rate[k] > 0.0;
+}
+
+bool FaultInjection::isEnabled() { return g_enabled; }
+
+ssize_t FaultInjection::recv(int fd, void* buf, std::size_t len, int flags) {
+	if (g_enabled) {
+		int err = pickError(ECONNRESET);
+		if (err) {
+			errno = err;
+			return -1;
+		}
+		len = shortLength(len);
+	}
+	return ::recv(fd, buf, len, flags);
+}
+
+ssize_t FaultInjection::send(int fd, const void* buf, std::size_t len, int flags) {
+	if (g_enabled) {
+		int err = pickError(ECONNRESET);
+		if (err) {
+			errno = err;
+			return -1;
+		}
+		len = shortLength(len);
+	}
+	return ::send(fd, buf, len, flags);
+}
+
+int FaultInjection::accept(int fd, sockaddr* addr, socklen_t* addr_len) {
+	if (g_enabled) {
+		int err = pickError(ECONNABORTED);
+		if (err) {
+			errno = err;
+			return -1;
+		}
+	}
+	return ::accept(fd, addr, addr_len);
+}
+
+std::uint64_t FaultInjection::getInjected(Kind kind) { return g_injected[kind]; }
+
+void FaultInjection::print(std::ostream& os) {
+	os << "faults";
+	for (int k = 0; k < KIND_COUNT; ++k)
+		os << " " << KIND_NAMES[k] << "=" << g_injected[k];
+	os << "\n";
+}
@@ -0,0 +1,303 @@
+/**
+ * @brief Asynchronous logger implementation
+ * 
+ * Ring: bounded lock-free queue (D. Vyukov's sequence-per-slot design).
+ * Each slot carries a sequence number; a producer claims a slot by CAS on
+ * the enqueue position, formats into it in place and publishes it by
+ * bumping the slot sequence. The writer thread is the only consumer.
+ */
+
+#include "utils/Logger.hpp"
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+
+namespace {
+
+const std::size_t	RING_SLOTS = 4096;			// power of two
+const std::size_t	TEXT_SIZE = 240;			// longer messages are truncated
+const std::size_t	SITE_SLOTS = 128;			// power of two, call sites tracked for suppression
+const std::uint32_t	SITE_BURST = 10;			// messages per call site per 1 s window
+const std::size_t	BATCH_SIZE = 65536;			// writer flushes at most this much per write()
+
+struct Slot {
+	std::atomic<std::size_t>	seq;
+	std::int64_t				sec;
+	long						nsec;
+	int							level;
+	const char*					site;
+	char						text[TEXT_SIZE];
+};
+
+struct SiteState {
+	std::atomic<const char*>	key;
+	std::atomic<std::int64_t>	window;			// realtime second of the current window
+	std::atomic<std::uint32_t>	count;
+	std::atomic<std::uint32_t>	suppressed;
+};
+
+Slot						g_ring[RING_SLOTS];
+SiteState					g_sites[SITE_SLOTS];
+std::atomic<std::size_t>	g_enqueue_pos(0);
+std::size_t					g_dequeue_pos = 0;	// writer thread only
+std::atomic<bool>			g_running(false);
+std::atomic<int>			g_min_level(Logger::Info);
+std::atomic<std::uint64_t>	g_dropped(0);
+std::atomic<std::uint64_t>	g_suppressed(0);
+std::thread					g_writer;
+
+const char* levelName(int level) {
+	switch (level) {
+		case Logger::Debug: return "DEBUG";
+		case Logger::Info: return "INFO";
+		case Logger::Warn: return "WARN";
+		default: return "ERROR";
+	}
+}
+
+// Write the whole buffer to stderr (only ever called from the writer thread or the sync fallback).
+void writeAll(const char* data, std::size_t len) {
+	while (len > 0) {
+		ssize_t n = ::write(STDERR_FILENO, data, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		data += n;
+		len -= static_cast<std::size_t>(n);
+	}
+}
+
+// Format one line "YYYY-mm-dd HH:MM:SS.mmm LEVEL [site] text\n" into out, returns its length.
+std::size_t formatLine(char* out, std::size_t cap, std::int64_t sec, long nsec,
+					   int level, const char* site, const char* text) {
+	std::time_t t = static_cast<std::time_t>(sec);
+	std::tm tm;
+	localtime_r(&t, &tm);
+	char stamp[32];
+	std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+	int n = std::snprintf(out, cap, "%s.%03ld %-5s [%s] %s\n",
+						  stamp, nsec / 1000000, levelName(level), site, text);
+	if (n < 0)
+		return 0;
+	return (static_cast<std::size_t>(n) < cap) ? static_cast<std::size_t>(n) : cap - 1;
+}
+
+// Find or claim the suppression state for a call site (NULL if the table is full).
+SiteState* findSite(const char* site) {
+	std::size_t h = (reinterpret_cast<std::uintptr_t>(site) >> 3) & (SITE_SLOTS - 1);
+	for (std::size_t i = 0; i < SITE_SLOTS; ++i) {
+		SiteState& st = g_sites[(h + i) & (SITE_SLOTS - 1)];
+		const char* key = st.key.load(std::memory_order_acquire);
+		if (key == site)
+			return &st;
+		if (key == NULL) {
+			const char* expected = NULL;
+			if (st.key.compare_exchange_strong(expected, site) || expected == site)
+				return &st;
+		}
+	}
+	return NULL;
+}
+
+/*
+	Rate limit per call site: SITE_BURST messages per second pass, the rest are counted.
+	When a new window starts, the number suppressed in the previous one is returned
+	through `summary` so the caller can emit one "N similar messages suppressed" line.
+*/
+bool admit(const char* site, std::int64_t sec, std::uint32_t& summary) {
+	summary = 0;
+	SiteState* st = findSite(site);
+	if (!st)
+		return true;
+	if (st->window.load(std::memory_order_relaxed) != sec) {
+		st->window.store(sec, std::memory_order_relaxed);
+		st->count.store(0, std::memory_order_relaxed);
+		summary = st->suppressed.exchange(0, std::memory_order_relaxed);
+	}
+	if (st->count.fetch_add(1, std::memory_order_relaxed) < SITE_BURST)
+		return true;
+	st->suppressed.fetch_add(1, std::memory_order_relaxed);
+	g_suppressed.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+// Claim a ring slot; NULL when the ring is full. The slot must be published with publish().
+Slot* claim(std::size_t& pos) {
+	pos = g_enqueue_pos.load(std::memory_order_relaxed);
+	for (;;) {
+		Slot& slot = g_ring[pos & (RING_SLOTS - 1)];
+		std::size_t seq = slot.seq.load(std::memory_order_acquire);
+		std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+		if (dif == 0) {
+			if (g_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				return &slot;
+		}
+		else if (dif < 0)
+			return NULL;
+		else
+			pos = g_enqueue_pos.load(std::memory_order_relaxed);
+	}
+}
+
+void publish(Slot* slot, std::size_t pos) {
+	slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+// Drain everything currently published, batching lines into few write() calls.
+bool drain() {
+	static char batch[BATCH_SIZE];
+	std::size_t used = 0;
+	bool any = false;
+	for (;;) {
+		Slot& slot = g_ring[g_dequeue_pos & (RING_SLOTS - 1)];
+		if (slot.seq.load(std::memory_order_acquire) != g_dequeue_pos + 1)
+			break;
+		if (BATCH_SIZE - used < TEXT_SIZE + 128) {
+			writeAll(batch, used);
+			used = 0;
+		}
+		used += formatLine(batch + used, BATCH_SIZE - used, slot.sec, slot.nsec,
+						   slot.level, slot.site, slot.text);
+		slot.seq.store(g_dequeue_pos + RING_SLOTS, std::memory_order_release);
+		++g_dequeue_pos;
+		any = true;
+	}
+	if (used > 0)
+		writeAll(batch, used);
+	return any;
+}
+
+void reportDropped(std::uint64_t& reported) {
+	std::uint64_t dropped = g_dropped.load(std::memory_order_relaxed);
+	if (dropped == reported)
+		return;
+	char line[128];
+	int n = std::snprintf(line, sizeof(line), "logger: %llu messages dropped (ring full)\n",
+						  static_cast<unsigned long long>(dropped - reported));
+	if (n > 0)
+		writeAll(line, static_cast<std::size_t>(n));
+	reported = dropped;
+}
+
+void writerLoop() {
+	std::uint64_t reported = 0;
+	while (g_running.load(std::memory_order_acquire)) {
+		bool any = drain();
+		reportDropped(reported);
+		if (!any)
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	drain();
+	reportDropped(reported);
+}
+
+} // namespace
+
+/**
+ * @brief Start the background writer thread
+ * @param min_level Messages below this level are discarded at the call site
+ */
+void Logger::start(Level min_level) {
+	if (g_running.load())
+		return;
+	for (std::size_t i = 0; i < RING_SLOTS; ++i)
+		g_ring[i].seq.store(i, std::memory_order_relaxed);
+	g_enqueue_pos.store(0);
+	g_dequeue_pos = 0;
+	g_min_level.store(min_level);
+	g_running.store(true, std::memory_order_release);
+	g_writer = std::thread(writerLoop);
+}
+
+/**
+ * @brief Stop the writer after draining everything already queued.
+ * Messages logged after stop() are written synchronously.
+ */
+void Logger::stop() {
+	if (!g_running.exchange(false))
+		return;
+	if (g_writer.joinable())
+		g_writer.join();
+}
+
+void Logger::setLevel(Level min_level) { g_min_level.store(min_level); }
+
+/**
+ * @brief Log one printf-style message without blocking
+ * @param level Severity
+ * @param site Call site literal (LOGGER_SITE), used as the suppression key
+ * @param fmt printf format
+ */
+void Logger::log(Level level, const char* site, const char* fmt, ...) {
+	if (level < g_min_level.load(std::memory_order_relaxed))
+		return;
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	std::uint32_t summary = 0;
+	bool admitted = (site == NULL) || admit(site, static_cast<std::int64_t>(ts.tv_sec), summary);
+	if (site == NULL)
+		site = "-";
+	if (!admitted && summary == 0)
+		return;
+
+	char text[TEXT_SIZE];
+	if (admitted) {
+		va_list args;
+		va_start(args, fmt);
+		std::vsnprintf(text, sizeof(text), fmt, args);
+		va_end(args);
+	}
+
+	// Writer not running: synchronous fallback
+	if (!g_running.load(std::memory_order_acquire)) {
+		char line[TEXT_SIZE + 128];
+		if (summary > 0) {
+			char note[64];
+			std::snprintf(note, sizeof(note), "%u similar messages suppressed", summary);
+			writeAll(line, formatLine(line, sizeof(line), ts.tv_sec, ts.tv_nsec, level, site, note));
+		}
+		if (admitted)
+			writeAll(line, formatLine(line, sizeof(line), ts.tv_sec, ts.tv_nsec, level, site, text));
+		return;
+	}
+
+	std::size_t pos;
+	if (summary > 0) {
+		Slot* slot = claim(pos);
+		if (!slot)
+			g_dropped.fetch_add(1, std::memory_order_relaxed);
+		else {
+			slot->sec = ts.tv_sec;
+			slot->nsec = ts.tv_nsec;
+			slot->level = level;
+			slot->site = site;
+			std::snprintf(slot->text, TEXT_SIZE, "%u similar messages suppressed", summary);
+			publish(slot, pos);
+		}
+	}
+	if (!admitted)
+		return;
+	Slot* slot = claim(pos);
+	if (!slot) {
+		g_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	slot->sec = ts.tv_sec;
+	slot->nsec = ts.tv_nsec;
+	slot->level = level;
+	slot->site = site;
+	std::memcpy(slot->text, text, std::strlen(text) + 1);
+	publish(slot, pos);
+}
+
+std::uint64_t Logger::getDroppedCount() { return g_dropped.load(std::memory_order_relaxed); }
+
+std::uint64_t Logger::getSuppressedCount() { return g_suppressed.load(std::memory_order_relaxed); }
@@ -0,0 +1,102 @@
+/**
+ * @brief Monotonic clock and log2 latency histogram implementation
+ */
+
+#include "utils/Metrics.hpp"
+#include <chrono>
+
+/**
+ * @brief Current monotonic time in microseconds
+ * 
+ * Only differences between two values are meaningful, the epoch is arbitrary.
+ */
+std::uint64_t Clock::nowMicros() {
+	return static_cast<std::uint64_t>(
+		std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+std::uint64_t Clock::wallMillis() {
+	return static_cast<std::uint64_t>(
+		std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+LatencyHistogram::LatencyHistogram()
+	: m_count(0), m_sum(0), m_max(0)
+{
+	reset();
+}
+
+/**
+ * @brief Record one sample
+ * @param value_us Sample value in microseconds
+ * 
+ * Bucket index is the bit width of the value, so bucket i covers
+ * [2^(i-1), 2^i). Values above the last bucket are clamped into it.
+ */
+void LatencyHistogram::record(std::uint64_t value_us) {
+	std::size_t idx = 0;
+	std::uint64_t v = value_us;
+	while (v != 0 && idx < BUCKETS - 1) {
+		v >>= 1;
+		++idx;
+	}
+	++m_buckets[idx];
+	++m_count;
+	m_sum += value_us;
+	if (value_us > m_max)
+		m_max = value_us;
+}
+
+void LatencyHistogram::reset() {
+	for (std::size_t i = 0; i < BUCKETS; ++i)
+		m_buckets[i] = 0;
+	m_count = 0;
+	m_sum = 0;
+	m_max = 0;
+}
+
+std::uint64_t LatencyHistogram::getCount() const { return m_count; }
+
+std::uint64_t LatencyHistogram::getMax() const { return m_max; }
+
+std::uint64_t LatencyHistogram::getMean() const {
+	return m_count == 0 ? 0 : m_sum / m_count;
+}
+
+/**
+ * @brief Approximate percentile
+ * @param p Fraction in range 0..1 (0.99 = p99)
+ * @return Upper bound of the bucket containing the requested rank,
+ * 		   never larger than the recorded maximum
+ */
+std::uint64_t LatencyHistogram::percentile(double p) const {
+	if (m_count == 0)
+		return 0;
+	std::uint64_t rank = static_cast<std::uint64_t>(p * static_cast<double>(m_count));
+	if (rank >= m_count)
+		rank = m_count - 1;
+	std::uint64_t seen = 0;
+	for (std::size_t i = 0; i < BUCKETS; ++i) {
+		seen += m_buckets[i];
+		if (seen > rank) {
+			std::uint64_t upper = (i == 0) ? 0 : ((std::uint64_t(1) << i) - 1);
+			return upper < m_max ? upper : m_max;
+		}
+	}
+	return m_max;
+}
+
+/**
+ * @brief Print one summary line: name count mean p50 p99 p999 max
+ */
+void LatencyHistogram::print(std::ostream& os, const char* name) const {
+	os << name
+	   << " count=" << m_count
+	   << " mean=" << getMean()
+	   << " p50=" << percentile(0.50)
+	   << " p99=" << percentile(0.99)
+	   << " p999=" << percentile(0.999)
+	   << " max=" << m_max << "\n";
+}
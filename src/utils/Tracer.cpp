@@ -0,0 +1,184 @@
+/**
+ * @brief Per-thread trace rings and Chrome trace-event JSON writer
+ */
+
+#include "utils/Tracer.hpp"
+#include "utils/Metrics.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__i386__)
+#	include <x86intrin.h>
+#endif
+
+namespace {
+
+const std::size_t	RING_EVENTS = 65536;		// per thread, ~2.5 MiB
+const std::size_t	ARG_SIZE = 16;				// command names longer than this are truncated
+
+struct TraceEvent {
+	std::uint64_t	begin;
+	std::uint64_t	end;
+	const char*		name;
+	char			arg[ARG_SIZE];
+};
+
+struct TraceRing {
+	std::vector<TraceEvent>	events;
+	std::uint64_t			written;			// total events ever written (index = written % RING_EVENTS)
+	long					tid;
+};
+
+std::mutex								g_rings_mutex;	// guards registration only, never taken while recording
+std::vector<std::unique_ptr<TraceRing>>	g_rings;
+thread_local TraceRing*					t_ring = NULL;
+
+// Calibration: (tsc, steady us) at start and stop of the session
+std::uint64_t	g_tsc_start = 0;
+std::uint64_t	g_us_start = 0;
+std::uint64_t	g_tsc_stop = 0;
+std::uint64_t	g_us_stop = 0;
+unsigned		g_dump_seq = 0;
+
+TraceRing* threadRing() {
+	if (t_ring)
+		return t_ring;
+	std::unique_ptr<TraceRing> ring(new TraceRing());
+	ring->events.resize(RING_EVENTS);
+	ring->written = 0;
+	ring->tid = static_cast<long>(::syscall(SYS_gettid));
+	t_ring = ring.get();
+	std::lock_guard<std::mutex> lock(g_rings_mutex);
+	g_rings.push_back(std::move(ring));
+	return t_ring;
+}
+
+// JSON string escaping (command names come from clients)
+void appendEscaped(std::string& out, const char* s) {
+	for (; *s; ++s) {
+		unsigned char c = static_cast<unsigned char>(*s);
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += static_cast<char>(c);
+		} else if (c < 0x20 || c >= 0x7f) {
+			char buf[8];
+			std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		} else
+			out += static_cast<char>(c);
+	}
+}
+
+} // namespace
+
+std::atomic<bool> Tracer::s_recording(false);
+
+/**
+ * @brief Raw timestamp: TSC ticks on x86, steady_clock microseconds elsewhere
+ */
+std::uint64_t Tracer::now() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return Clock::nowMicros();
+#endif
+}
+
+/**
+ * @brief Start a new recording session: previous events are discarded.
+ */
+void Tracer::start() {
+	{
+		std::lock_guard<std::mutex> lock(g_rings_mutex);
+		for (std::size_t i = 0; i < g_rings.size(); ++i)
+			g_rings[i]->written = 0;
+	}
+	g_us_start = Clock::nowMicros();
+	g_tsc_start = now();
+	s_recording.store(true, std::memory_order_release);
+}
+
+void Tracer::stop() {
+	if (!s_recording.exchange(false))
+		return;
+	g_us_stop = Clock::nowMicros();
+	g_tsc_stop = now();
+}
+
+bool Tracer::isRecording() { return s_recording.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Append one complete event to the calling thread's ring (overwrites the oldest when full)
+ */
+void Tracer::record(const char* name, const char* arg, std::uint64_t begin, std::uint64_t end) {
+	TraceRing* ring = threadRing();
+	TraceEvent& ev = ring->events[ring->written % RING_EVENTS];
+	ev.begin = begin;
+	ev.end = end;
+	ev.name = name;
+	if (arg) {
+		std::strncpy(ev.arg, arg, ARG_SIZE - 1);
+		ev.arg[ARG_SIZE - 1] = '\0';
+	} else
+		ev.arg[0] = '\0';
+	++ring->written;
+}
+
+/**
+ * @brief Write the recorded session as Chrome trace-event JSON
+ * @return Path of the written file, empty string if it could not be written
+ * 
+ * Ticks are converted with the ratio measured between start() and stop();
+ * "ts"/"dur" are microseconds relative to the session start.
+ */
+std::string Tracer::dump() {
+	double ticks_per_us = 1.0;
+	if (g_us_stop > g_us_start && g_tsc_stop > g_tsc_start)
+		ticks_per_us = static_cast<double>(g_tsc_stop - g_tsc_start) / static_cast<double>(g_us_stop - g_us_start);
+
+	std::ostringstream path;
+	path << "ircserv-trace-" << ::getpid() << "-" << g_dump_seq++ << ".json";
+	std::ofstream file(path.str().c_str());
+	if (!file)
+		return "";
+
+	long pid = static_cast<long>(::getpid());
+	std::string line;
+	file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	bool first = true;
+	std::lock_guard<std::mutex> lock(g_rings_mutex);
+	for (std::size_t r = 0; r < g_rings.size(); ++r) {
+		const TraceRing& ring = *g_rings[r];
+		std::uint64_t count = ring.written < RING_EVENTS ? ring.written : RING_EVENTS;
+		for (std::uint64_t i = ring.written - count; i < ring.written; ++i) {
+			const TraceEvent& ev = ring.events[i % RING_EVENTS];
+			if (ev.begin < g_tsc_start)
+				continue;
+			char nums[128];
+			std::snprintf(nums, sizeof(nums), "\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f",
+						  pid, ring.tid,
+						  static_cast<double>(ev.begin - g_tsc_start) / ticks_per_us,
+						  static_cast<double>(ev.end - ev.begin) / ticks_per_us);
+			line.clear();
+			line += first ? "{\"name\":\"" : ",\n{\"name\":\"";
+			appendEscaped(line, ev.name);
+			line += nums;
+			if (ev.arg[0] != '\0') {
+				line += ",\"args\":{\"arg\":\"";
+				appendEscaped(line, ev.arg);
+				line += "\"}";
+			}
+			line += "}";
+			file << line;
+			first = false;
+		}
+	}
+	file << "\n]}\n";
+	return file ? path.str() : "";
+}